@@ -0,0 +1,138 @@
+#ifndef JNP1_ANY_ORGANISM_H
+#define JNP1_ANY_ORGANISM_H
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "organism.h"
+
+namespace {
+using std::span, std::invalid_argument;
+}  // namespace
+
+// Organizm, którego preferencje żywieniowe są znane dopiero w czasie
+// wykonania, zapisane jako Diet obok witalności. Organizmy różnych diet
+// mieszczą się w jednym kontenerze bez std::variant, a spotkania wybierają
+// regułę odczytem interaction_table zamiast wywołań wirtualnych. Witalność
+// jest typu i polityki policy_t, tak jak w Organism.
+template <typename species_t, vitality_policy policy_t = wrapping_vitality>
+requires equality_comparable<species_t> class AnyOrganism {
+ public:
+  using vitality_type = typename policy_t::value_type;
+  using policy_type = policy_t;
+
+ private:
+  // Dieta obok gatunku, żeby dla małych gatunków zmieściła się w wyrównaniu.
+  species_t species;
+  Diet diet;
+  vitality_type vitality;
+
+ public:
+  constexpr AnyOrganism(species_t const &species, Diet diet,
+                        vitality_type vitality)
+      : species(species), diet(diet), vitality(vitality) {
+  }
+
+  constexpr AnyOrganism(species_t &&species, Diet diet,
+                        vitality_type vitality)
+      : species(std::move(species)), diet(diet), vitality(vitality) {
+  }
+
+  template <bool can_eat_meat, bool can_eat_plants>
+  constexpr AnyOrganism(
+      Organism<species_t, can_eat_meat, can_eat_plants, policy_t> const
+          &organism)
+      : AnyOrganism(organism.get_species(), organism.diet,
+                    organism.get_vitality()) {
+  }
+
+  constexpr vitality_type get_vitality() const {
+    return vitality;
+  }
+
+  constexpr bool is_dead() const {
+    return vitality == 0;
+  }
+
+  constexpr const species_t &get_species() const {
+    return species;
+  }
+
+  constexpr Diet get_diet() const {
+    return diet;
+  }
+
+  constexpr bool is_plant() const {
+    return diet_is_plant(diet);
+  }
+
+  constexpr auto set_vitality(vitality_type new_vitality) const & {
+    return AnyOrganism(species, diet, new_vitality);
+  }
+  constexpr auto set_vitality(vitality_type new_vitality) && {
+    return AnyOrganism(std::move(species), diet, new_vitality);
+  }
+
+  // Powrót do organizmu z szablonu; preferencje muszą się zgadzać.
+  template <bool can_eat_meat, bool can_eat_plants>
+  constexpr Organism<species_t, can_eat_meat, can_eat_plants, policy_t> as()
+      const {
+    if (diet != make_diet(can_eat_meat, can_eat_plants)) {
+      throw invalid_argument("Diet mismatch");
+    }
+    return {species, vitality};
+  }
+};
+
+// Odpowiednik encounter dla organizmów o preferencjach znanych w czasie
+// wykonania. Spotkanie dwóch roślin rzuca logic_error.
+template <typename species_t, typename policy_t>
+constexpr tuple<AnyOrganism<species_t, policy_t>,
+                AnyOrganism<species_t, policy_t>,
+                optional<AnyOrganism<species_t, policy_t>>>
+encounter(AnyOrganism<species_t, policy_t> organism1,
+          AnyOrganism<species_t, policy_t> organism2) {
+  const auto outcome = encounter_outcome_of<policy_t>(
+      organism1.get_diet(), organism2.get_diet(),
+      organism1.get_species() == organism2.get_species(),
+      organism1.get_vitality(), organism2.get_vitality());
+  optional<AnyOrganism<species_t, policy_t>> child;
+  if (outcome.has_child) {
+    child.emplace(organism1.get_species(), organism1.get_diet(),
+                  outcome.child_vitality);
+    count_offspring();
+  }
+  return {std::move(organism1).set_vitality(outcome.vitality1),
+          std::move(organism2).set_vitality(outcome.vitality2),
+          std::move(child)};
+}
+
+// Seria spotkań z organizmami z prey, zakończona śmiercią pierwszego.
+template <typename species_t, typename policy_t>
+constexpr series_result<AnyOrganism<species_t, policy_t>>
+encounter_series_counted(AnyOrganism<species_t, policy_t> organism1,
+                         span<const AnyOrganism<species_t, policy_t>> prey) {
+  size_t encounters = 0;
+  for (; encounters < prey.size() && !organism1.is_dead(); ++encounters) {
+    const AnyOrganism<species_t, policy_t> &other = prey[encounters];
+    const auto outcome = encounter_outcome_of<policy_t>(
+        organism1.get_diet(), other.get_diet(),
+        organism1.get_species() == other.get_species(),
+        organism1.get_vitality(), other.get_vitality());
+    organism1 = std::move(organism1).set_vitality(outcome.vitality1);
+  }
+  return {std::move(organism1), encounters};
+}
+
+template <typename species_t, typename policy_t>
+constexpr AnyOrganism<species_t, policy_t> encounter_series(
+    AnyOrganism<species_t, policy_t> organism1,
+    span<const AnyOrganism<species_t, policy_t>> prey) {
+  return encounter_series_counted(std::move(organism1), prey).hunter;
+}
+
+#endif  // JNP1_ANY_ORGANISM_H
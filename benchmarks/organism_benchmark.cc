@@ -0,0 +1,378 @@
+// Pomiary przepustowości spotkań. Wyniki w JSON:
+//     ./jnp1_organism_benchmark --benchmark_format=json
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "any_organism.h"
+#include "device_population.h"
+#include "event_log.h"
+#include "organism.h"
+#include "packed_organism.h"
+#include "population.h"
+#include "population_stats.h"
+#include "scheduler.h"
+#include "simulation_task.h"
+#include "snapshot.h"
+#include "species_registry.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Witalności zmieniające się co iterację, żeby kompilator nie policzył
+// spotkania z góry i żeby trafiały się różne gałęzie reguł.
+vitality_t next_vitality(vitality_t &state) {
+  state = state * 6364136223846793005u + 1442695040888963407u;
+  return (state >> 33) % 100 + 1;
+}
+
+template <typename species_t>
+species_t make_species(int id);
+
+template <>
+uint8_t make_species<uint8_t>(int id) {
+  return static_cast<uint8_t>(id);
+}
+
+// Nazwy dłuższe niż bufor krótkich napisów, żeby kopia przydzielała pamięć.
+template <>
+std::string make_species<std::string>(int id) {
+  return "Species with a rather long latin name no. " + std::to_string(id);
+}
+
+template <>
+species_handle make_species<species_handle>(int id) {
+  return {static_cast<uint32_t>(id)};
+}
+
+template <typename organism1_t, typename organism2_t>
+void encounter_diets(benchmark::State &state) {
+  vitality_t seed = 1;
+  for (auto _ : state) {
+    organism1_t organism1(1, next_vitality(seed));
+    organism2_t organism2(2, next_vitality(seed));
+    benchmark::DoNotOptimize(organism1);
+    benchmark::DoNotOptimize(organism2);
+    auto result = encounter(organism1, organism2);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename species_t>
+void encounter_species(benchmark::State &state) {
+  Carnivore<species_t> wolf(make_species<species_t>(1), 100);
+  Omnivore<species_t> dog(make_species<species_t>(2), 10);
+  for (auto _ : state) {
+    auto result = encounter(wolf, dog);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// To samo, ale z organizmami przeniesionymi do encounter.
+template <typename species_t>
+void encounter_species_moved(benchmark::State &state) {
+  Carnivore<species_t> wolf(make_species<species_t>(1), 100);
+  Omnivore<species_t> dog(make_species<species_t>(2), 10);
+  for (auto _ : state) {
+    auto [wolf_result, dog_result, child] =
+        encounter(std::move(wolf), std::move(dog));
+    benchmark::DoNotOptimize(child);
+    wolf = std::move(wolf_result).set_vitality(100);
+    dog = std::move(dog_result).set_vitality(10);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <size_t... indices>
+auto template_series(Carnivore<uint8_t> hunter, std::index_sequence<indices...>,
+                     const std::vector<Herbivore<uint8_t>> &prey) {
+  return encounter_series(hunter, prey[indices]...);
+}
+
+template <size_t length>
+void encounter_series_template(benchmark::State &state) {
+  vitality_t seed = 1;
+  std::vector<Herbivore<uint8_t>> prey;
+  for (size_t i = 0; i < length; ++i) {
+    prey.emplace_back(2, next_vitality(seed));
+  }
+  for (auto _ : state) {
+    Carnivore<uint8_t> hunter(1, 1000);
+    benchmark::DoNotOptimize(hunter);
+    auto result =
+        template_series(hunter, std::make_index_sequence<length>(), prey);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * length);
+}
+
+void encounter_series_runtime(benchmark::State &state) {
+  vitality_t seed = 1;
+  std::vector<AnyOrganism<species_handle>> prey;
+  const Diet diets[] = {Diet::herbivore, Diet::omnivore, Diet::plant};
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    prey.emplace_back(species_handle{2}, diets[i % 3], next_vitality(seed));
+  }
+  // Myśliwy dość silny, żeby przeżyć całą serię.
+  const AnyOrganism<species_handle> hunter(species_handle{1}, Diet::omnivore,
+                                           1000000);
+  for (auto _ : state) {
+    auto result = encounter_series_counted(
+        hunter, span<const AnyOrganism<species_handle>>(prey));
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename policy_t>
+Population<uint32_t, policy_t> random_population(size_t size) {
+  std::mt19937_64 generator(1);
+  Population<uint32_t, policy_t> population;
+  const Diet diets[] = {Diet::carnivore, Diet::omnivore, Diet::herbivore,
+                        Diet::plant};
+  for (size_t i = 0; i < size; ++i) {
+    population.add(generator() % 64, diets[generator() % 4],
+                   generator() % 1000 + 1);
+  }
+  return population;
+}
+
+// Wspólny szkielet pomiarów na populacji: każda iteracja zaczyna od tej samej
+// populacji i tych samych par.
+template <typename policy_t = wrapping_vitality, typename engine_t>
+void population_benchmark(benchmark::State &state, engine_t &&engine) {
+  const auto initial = random_population<policy_t>(state.range(0));
+  std::mt19937_64 generator(2);
+  const auto pairs = random_matching(initial, generator);
+  Population<uint32_t, policy_t> population;
+  for (auto _ : state) {
+    state.PauseTiming();
+    population = initial;
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(engine(population, span(pairs)));
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+void batch_scalar(benchmark::State &state) {
+  population_benchmark(state, [](auto &population, auto pairs) {
+    return encounter_batch(population, pairs);
+  });
+}
+
+void batch_simd(benchmark::State &state) {
+  population_benchmark(state, [](auto &population, auto pairs) {
+    return encounter_batch_simd(population, pairs);
+  });
+}
+
+void batch_bucketed(benchmark::State &state) {
+  population_benchmark(state, [](auto &population, auto pairs) {
+    return encounter_batch_bucketed(population, pairs);
+  });
+}
+
+// Te same organizmy i pary co w batch_scalar, spakowane po 8 bajtów.
+void batch_packed(benchmark::State &state) {
+  const auto population = random_population<wrapping_vitality>(state.range(0));
+  std::vector<PackedOrganism<uint8_t>> initial;
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    initial.emplace_back(static_cast<uint8_t>(population.get_species(i)),
+                         population.get_diet(i), population.get_vitality(i));
+  }
+  std::mt19937_64 generator(2);
+  const auto pairs = random_matching(population, generator);
+  std::vector<PackedOrganism<uint8_t>> organisms;
+  for (auto _ : state) {
+    state.PauseTiming();
+    organisms = initial;
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(encounter_batch(organisms, span(pairs)));
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+// Populacja na akceleratorze; kopiowanie jej tam nie jest mierzone, bo
+// zdarza się raz na wiele rund.
+void batch_device(benchmark::State &state) {
+  const auto initial = random_population<wrapping_vitality>(state.range(0));
+  std::mt19937_64 generator(2);
+  const auto pairs = random_matching(initial, generator);
+  std::optional<DevicePopulation<uint32_t>> device;
+  for (auto _ : state) {
+    state.PauseTiming();
+    device.emplace(initial);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(device->encounter_batch(span(pairs)));
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+// Polityka i szerokość witalności populacji.
+template <typename policy_t>
+void batch_simd_policy(benchmark::State &state) {
+  population_benchmark<policy_t>(state, [](auto &population, auto pairs) {
+    return encounter_batch_simd(population, pairs);
+  });
+}
+
+void round_parallel(benchmark::State &state) {
+  ThreadPool pool(state.range(1));
+  RoundBirths births(pool.size());
+  population_benchmark(state, [&](auto &population, auto pairs) {
+    return encounter_round(population, pairs, pool, births);
+  });
+}
+
+// Runda w kawałkach po range(1) spotkań, w jednym wątku; koszt przerw
+// względem round_parallel z jednym wątkiem.
+void round_steps(benchmark::State &state) {
+  population_benchmark(state, [&](auto &population, auto pairs) {
+    return encounter_round_steps(population, pairs, state.range(1)).run();
+  });
+}
+
+// To samo z dziennikiem wszystkich spotkań.
+void round_parallel_logged(benchmark::State &state) {
+  ThreadPool pool(state.range(1));
+  RoundBirths births(pool.size());
+  const auto path =
+      (std::filesystem::temp_directory_path() / "jnp1_events.bin").string();
+  EncounterEventLog log(path, pool.size());
+  uint64_t round = 0;
+  population_benchmark(state, [&](auto &population, auto pairs) {
+    return encounter_round(population, pairs, pool, births,
+                           log.recorder(round++, pool));
+  });
+  log.flush();
+  std::filesystem::remove(path);
+}
+
+// Runda z poprawianiem statystyk i, dla porównania, z liczeniem ich od nowa.
+// Drugi argument to pula, trzeci mówi, że spotyka się tylko co 1/n-ta para.
+void round_parallel_stats(benchmark::State &state) {
+  ThreadPool pool(state.range(1));
+  RoundBirths births(pool.size());
+  PopulationStatistics stats;
+  population_benchmark(state, [&](auto &population, auto pairs) {
+    const size_t born = encounter_round(
+        population, pairs.first(pairs.size() / state.range(2)), pool, births,
+        stats.recorder(population, pool));
+    stats.commit(population, born);
+    return born;
+  });
+}
+
+void round_parallel_rescan(benchmark::State &state) {
+  ThreadPool pool(state.range(1));
+  RoundBirths births(pool.size());
+  population_benchmark(state, [&](auto &population, auto pairs) {
+    const size_t born = encounter_round(
+        population, pairs.first(pairs.size() / state.range(2)), pool, births);
+    PopulationStatistics stats(population);
+    benchmark::DoNotOptimize(stats);
+    return born;
+  });
+}
+
+// Zapis i wczytanie zrzutu populacji; bajty na sekundę to rozmiar pliku.
+void snapshot_save(benchmark::State &state) {
+  const auto population =
+      random_population<wrapping_vitality>(state.range(0));
+  const auto path =
+      (std::filesystem::temp_directory_path() / "jnp1_benchmark.bin").string();
+  for (auto _ : state) {
+    save_snapshot(path, population);
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          std::filesystem::file_size(path));
+  std::filesystem::remove(path);
+}
+
+void snapshot_load(benchmark::State &state) {
+  const auto path =
+      (std::filesystem::temp_directory_path() / "jnp1_benchmark.bin").string();
+  save_snapshot(path, random_population<wrapping_vitality>(state.range(0)));
+  for (auto _ : state) {
+    auto population = load_snapshot<uint32_t>(path);
+    benchmark::DoNotOptimize(population);
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          std::filesystem::file_size(path));
+  std::filesystem::remove(path);
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(encounter_diets, Carnivore<uint8_t>, Carnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Carnivore<uint8_t>, Omnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Carnivore<uint8_t>, Herbivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Carnivore<uint8_t>, Plant<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Omnivore<uint8_t>, Carnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Omnivore<uint8_t>, Omnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Omnivore<uint8_t>, Herbivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Omnivore<uint8_t>, Plant<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Herbivore<uint8_t>, Carnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Herbivore<uint8_t>, Omnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Herbivore<uint8_t>, Herbivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Herbivore<uint8_t>, Plant<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Plant<uint8_t>, Carnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Plant<uint8_t>, Omnivore<uint8_t>);
+BENCHMARK_TEMPLATE(encounter_diets, Plant<uint8_t>, Herbivore<uint8_t>);
+
+BENCHMARK_TEMPLATE(encounter_species, uint8_t);
+BENCHMARK_TEMPLATE(encounter_species, std::string);
+BENCHMARK_TEMPLATE(encounter_species, species_handle);
+BENCHMARK_TEMPLATE(encounter_species_moved, std::string);
+
+BENCHMARK_TEMPLATE(encounter_series_template, 1);
+BENCHMARK_TEMPLATE(encounter_series_template, 8);
+BENCHMARK_TEMPLATE(encounter_series_template, 64);
+BENCHMARK_TEMPLATE(encounter_series_template, 256);
+BENCHMARK(encounter_series_runtime)->RangeMultiplier(8)->Range(1, 1 << 15);
+
+BENCHMARK(batch_scalar)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(batch_simd)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(batch_packed)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(batch_bucketed)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(batch_device)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(batch_simd_policy, saturating_vitality)
+    ->RangeMultiplier(16)
+    ->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(batch_simd_policy, basic_saturating_vitality<uint32_t>)
+    ->RangeMultiplier(16)
+    ->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(batch_simd_policy, basic_saturating_vitality<uint16_t>)
+    ->RangeMultiplier(16)
+    ->Range(1 << 10, 1 << 22);
+BENCHMARK(round_parallel)
+    ->ArgsProduct({{1 << 14, 1 << 18, 1 << 22}, {1, 2, 4, 8}})
+    ->UseRealTime();
+
+BENCHMARK(round_steps)
+    ->ArgsProduct({{1 << 14, 1 << 18, 1 << 22}, {64, 4096}})
+    ->UseRealTime();
+
+BENCHMARK(round_parallel_logged)
+    ->ArgsProduct({{1 << 14, 1 << 18, 1 << 22}, {1, 2, 4, 8}})
+    ->UseRealTime();
+
+BENCHMARK(round_parallel_stats)
+    ->ArgsProduct({{1 << 14, 1 << 18, 1 << 22}, {1, 4}, {1, 64}})
+    ->UseRealTime();
+BENCHMARK(round_parallel_rescan)
+    ->ArgsProduct({{1 << 14, 1 << 18, 1 << 22}, {1, 4}, {1, 64}})
+    ->UseRealTime();
+
+BENCHMARK(snapshot_save)->RangeMultiplier(16)->Range(1 << 14, 1 << 22);
+BENCHMARK(snapshot_load)->RangeMultiplier(16)->Range(1 << 14, 1 << 22);
+
+BENCHMARK_MAIN();
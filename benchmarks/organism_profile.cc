@@ -0,0 +1,223 @@
+// Profil silnika spotkań: kolejne etapy na tej samej populacji o mieszanych
+// dietach, z licznikami procesora na jedno spotkanie. Każdy etap liczy się
+// w osobnej funkcji profile_<etap>, więc w perf report i na wykresach
+// płomieniowych widać, który etap zajmuje czas:
+//     ./jnp1_organism_profile [size] [repeats] [stage]
+//     perf record -g ./jnp1_organism_profile 1048576 20 encounter_round
+// Z JNP1_ORGANISM_COUNTERS wypisywany jest też udział reguł w spotkaniach
+// etapu i liczba dzieci na sto spotkań.
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "birth_arena.h"
+#include "counter_rng.h"
+#include "encounter_counters.h"
+#include "organism.h"
+#include "perf_counters.h"
+#include "population.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+
+namespace {
+
+using profile_population = Population<uint32_t, wrapping_vitality>;
+
+// Jak w organism_benchmark.cc, ale z przewagą zwierząt, żeby występowały
+// wszystkie reguły, a pary dwóch roślin były rzadkie.
+profile_population mixed_population(size_t size) {
+  std::mt19937_64 generator(1);
+  profile_population population;
+  const Diet diets[] = {Diet::carnivore, Diet::carnivore, Diet::omnivore,
+                        Diet::omnivore,  Diet::herbivore, Diet::herbivore,
+                        Diet::herbivore, Diet::plant};
+  for (size_t i = 0; i < size; ++i) {
+    population.add(generator() % 64, diets[generator() % 8],
+                   generator() % 1000 + 1);
+  }
+  return population;
+}
+
+// Dane wspólne wszystkim etapom. Wynik etapu trafia do sink, żeby kompilator
+// nie mógł go pominąć.
+struct profile_input {
+  const profile_population &initial;
+  const std::vector<encounter_pair_t> &pairs;
+  const std::vector<encounter_chain> &chains;
+  ThreadPool &pool;
+  RoundBirths &births;
+};
+
+volatile size_t sink;
+
+[[gnu::noinline]] void profile_random_matching(profile_population &population,
+                                               const profile_input &input) {
+  sink = random_matching(population, CounterRng(3), 0, input.pool).size();
+}
+
+[[gnu::noinline]] void profile_encounter_round(profile_population &population,
+                                               const profile_input &input) {
+  sink = encounter_round(population, span(input.pairs), input.pool,
+                         input.births);
+}
+
+[[gnu::noinline]] void profile_encounter_batch(profile_population &population,
+                                               const profile_input &input) {
+  sink = encounter_batch(population, span(input.pairs));
+}
+
+[[gnu::noinline]] void profile_encounter_batch_simd(
+    profile_population &population, const profile_input &input) {
+  sink = encounter_batch_simd(population, span(input.pairs));
+}
+
+[[gnu::noinline]] void profile_encounter_batch_bucketed(
+    profile_population &population, const profile_input &input) {
+  sink = encounter_batch_bucketed(population, span(input.pairs));
+}
+
+[[gnu::noinline]] void profile_encounter_series(profile_population &population,
+                                                const profile_input &input) {
+  sink = encounter_series_parallel(population, span(input.chains), input.pool)
+             .size();
+}
+
+struct profile_stage {
+  std::string_view name;
+  void (*run)(profile_population &, const profile_input &);
+  // Liczba spotkań jednego wykonania; przy kojarzeniu liczba par, a przy
+  // seriach liczba ofiar, choć seria kończy się wcześniej po śmierci
+  // zjadającego.
+  size_t (*encounters)(const profile_input &);
+};
+
+size_t pair_count(const profile_input &input) {
+  return input.pairs.size();
+}
+
+size_t chain_encounters(const profile_input &input) {
+  size_t encounters = 0;
+  for (const auto &chain : input.chains) {
+    encounters += chain.prey.size();
+  }
+  return encounters;
+}
+
+constexpr profile_stage stages[] = {
+    {"random_matching", profile_random_matching, pair_count},
+    {"encounter_round", profile_encounter_round, pair_count},
+    {"encounter_batch", profile_encounter_batch, pair_count},
+    {"encounter_batch_simd", profile_encounter_batch_simd, pair_count},
+    {"encounter_batch_bucketed", profile_encounter_batch_bucketed, pair_count},
+    {"encounter_series", profile_encounter_series, chain_encounters},
+};
+
+constexpr std::string_view rule_names[encounter_rule_count] = {
+    "dead",           "same_species",    "inert",          "mutual",
+    "plant_eaten",    "one_way_success", "one_way_fail",
+};
+
+void print_value(std::optional<uint64_t> value, double encounters) {
+  if (value) {
+    std::printf(" %12.2f", static_cast<double>(*value) / encounters);
+  } else {
+    std::printf(" %12s", "n/a");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const size_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 20;
+  const size_t repeats = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 5;
+  const std::string_view only = argc > 3 ? argv[3] : "";
+  if (size < 2 || repeats == 0) {
+    std::fprintf(stderr, "usage: %s [size >= 2] [repeats > 0] [stage]\n",
+                 argv[0]);
+    return 1;
+  }
+
+  // Przed pulą, żeby liczniki obejmowały też jej wątki.
+  PerfCounters counters;
+  ThreadPool pool;
+  RoundBirths births(pool.size());
+
+  const profile_population initial = mixed_population(size);
+  std::mt19937_64 generator(2);
+  const auto pairs = random_matching(initial, generator);
+  // Serie po 64 ofiary dla mięsożerców i wszystkożerców z pierwszej tysięcznej
+  // populacji.
+  std::vector<population_index_t> prey(64);
+  for (auto &index : prey) {
+    index = static_cast<population_index_t>(generator() % size);
+  }
+  std::vector<encounter_chain> chains;
+  for (population_index_t index = 0; index < size / 1000 + 1; ++index) {
+    if (diet_can_eat(initial.get_diet(index), Diet::herbivore)) {
+      chains.push_back({index, span(prey)});
+    }
+  }
+  const profile_input input{initial, pairs, chains, pool, births};
+
+  // Czas procesora wszystkich wątków, nie czas rzeczywisty.
+  std::printf("%zu organisms, %zu pairs, %zu threads, %zu repeats\n", size,
+              pairs.size(), pool.size(), repeats);
+  for (size_t event = 0; event < perf_event_count; ++event) {
+    const auto kind = static_cast<PerfEvent>(event);
+    if (!counters.available(kind)) {
+      std::printf("%s unavailable: %s\n", perf_event_name(kind).data(),
+                  counters.unavailable_reason(kind).message().c_str());
+    }
+  }
+  std::printf("\n%-25s %12s", "per encounter", "cpu-ns");
+  for (size_t event = 0; event + 1 < perf_event_count; ++event) {
+    std::printf(" %12s", perf_event_name(static_cast<PerfEvent>(event)).data());
+  }
+  std::printf("\n");
+
+  for (const profile_stage &stage : stages) {
+    if (!only.empty() && stage.name != only) {
+      continue;
+    }
+    perf_sample total;
+    size_t encounters = 0;
+    reset_encounter_counters();
+    for (size_t repeat = 0; repeat < repeats; ++repeat) {
+      // Kopia populacji nie jest mierzona.
+      profile_population population = initial;
+      const perf_sample sample =
+          counters.measure([&] { stage.run(population, input); });
+      for (size_t event = 0; event < perf_event_count; ++event) {
+        if (sample.values[event]) {
+          total.values[event] =
+              total.values[event].value_or(0) + *sample.values[event];
+        }
+      }
+      encounters += stage.encounters(input);
+    }
+    const double per = encounters == 0 ? 1 : static_cast<double>(encounters);
+    std::printf("%-25s", stage.name.data());
+    print_value(total[PerfEvent::task_clock], per);
+    for (size_t event = 0; event + 1 < perf_event_count; ++event) {
+      print_value(total.values[event], per);
+    }
+    std::printf("\n");
+
+    const encounter_counts counts = encounter_counters();
+    if (counts.encounters() > 0) {
+      const auto rules = static_cast<double>(counts.encounters());
+      for (size_t rule = 0; rule < encounter_rule_count; ++rule) {
+        std::printf("  %-23s %11.1f%%\n", rule_names[rule].data(),
+                    100.0 * static_cast<double>(counts.rules[rule]) / rules);
+      }
+      std::printf("  %-23s %11.1f%%\n", "offspring",
+                  100.0 * static_cast<double>(counts.offspring) / rules);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+// Czas kompilacji encounter_series dla serii długości SERIES_LENGTH,
+// obliczanej w całości w czasie kompilacji.
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+#include "organism.h"
+
+#ifndef SERIES_LENGTH
+#define SERIES_LENGTH 10
+#endif
+
+template <size_t... indices>
+constexpr auto long_series(std::index_sequence<indices...>) {
+  // Na przemian rośliny i silniejsi roślinożercy, więc każde spotkanie
+  // przechodzi przez inne reguły.
+  return encounter_series(
+      Omnivore<size_t>(0, 1),
+      std::get<indices % 2>(
+          std::tuple{Plant<size_t>(1, 1),
+                     Herbivore<size_t>(2, SERIES_LENGTH * 4)})...);
+}
+
+constexpr auto hunter =
+    long_series(std::make_index_sequence<SERIES_LENGTH>());
+static_assert(!hunter.is_dead());
+
+int main() {
+  return 0;
+}
@@ -0,0 +1,12 @@
+# Mierzy czas wykonania polecenia z dokładnością do milisekund:
+#     cmake -DLABEL=... -DTIMED_COMMAND="a|b|c" -P time_command.cmake
+string(REPLACE "|" ";" TIMED_COMMAND "${TIMED_COMMAND}")
+string(TIMESTAMP start "%s%f" UTC)
+execute_process(COMMAND ${TIMED_COMMAND} RESULT_VARIABLE result)
+string(TIMESTAMP end "%s%f" UTC)
+
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${LABEL}: failed (${result})")
+endif ()
+math(EXPR elapsed_ms "(${end} - ${start}) / 1000")
+message("${LABEL}: ${elapsed_ms} ms")
@@ -0,0 +1,118 @@
+#ifndef JNP1_BIRTH_ARENA_H
+#define JNP1_BIRTH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "organism.h"
+#include "species_registry.h"
+
+namespace {
+using std::vector, std::unique_ptr;
+}  // namespace
+
+// Dziecko, które jeszcze nie zostało dopisane do populacji.
+struct birth_record {
+  species_handle species;
+  Diet diet;
+  vitality_t vitality;
+};
+
+// Bufor dzieci urodzonych w jednej rundzie. Pamięć jest przydzielana blokami,
+// które się nie przesuwają, więc dopisywanie nie kopiuje wcześniejszych dzieci,
+// a numery i referencje pozostają ważne do reset. Po reset bloki są używane
+// ponownie, więc w ustalonym stanie runda w ogóle nie przydziela pamięci.
+class BirthArena {
+  static constexpr size_t block_size = 4096;
+
+  vector<unique_ptr<birth_record[]>> blocks;
+  size_t used = 0;
+
+ public:
+  size_t size() const {
+    return used;
+  }
+
+  size_t capacity() const {
+    return blocks.size() * block_size;
+  }
+
+  size_t push(const birth_record &child) {
+    if (used == capacity()) {
+      blocks.push_back(std::make_unique<birth_record[]>(block_size));
+    }
+    blocks[used / block_size][used % block_size] = child;
+    return used++;
+  }
+
+  const birth_record &operator[](size_t index) const {
+    return blocks[index / block_size][index % block_size];
+  }
+
+  void reset() {
+    used = 0;
+  }
+};
+
+// Dzieci z rundy liczonej równolegle: każdy wątek ma własną arenę, a dla
+// każdego fragmentu par zapamiętujemy, gdzie trafiły jego dzieci. Dzięki temu
+// wątki nie dzielą pamięci, a dzieci można odczytać w kolejności par.
+class RoundBirths {
+  struct chunk_births {
+    size_t worker = 0;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  vector<BirthArena> arenas;
+  vector<chunk_births> chunks;
+
+ public:
+  explicit RoundBirths(size_t workers = 1) : arenas(workers) {
+  }
+
+  // Początek rundy: chunk_count fragmentów liczonych przez workers wątków.
+  void reset(size_t workers, size_t chunk_count) {
+    if (arenas.size() < workers) {
+      arenas.resize(workers);
+    }
+    for (auto &arena : arenas) {
+      arena.reset();
+    }
+    chunks.assign(chunk_count, {});
+  }
+
+  BirthArena &arena(size_t worker) {
+    return arenas[worker];
+  }
+
+  void set_chunk(size_t chunk, size_t worker, size_t begin, size_t end) {
+    chunks[chunk] = {worker, begin, end};
+  }
+
+  size_t size() const {
+    size_t total = 0;
+    for (const auto &arena : arenas) {
+      total += arena.size();
+    }
+    return total;
+  }
+
+  // Wywołuje fn dla każdego dziecka, w kolejności fragmentów, ale co
+  // najwyżej dla limit pierwszych.
+  template <typename function_t>
+  void for_each(function_t &&fn, size_t limit = SIZE_MAX) const {
+    for (const auto &chunk : chunks) {
+      for (size_t index = chunk.begin; index < chunk.end; ++index) {
+        if (limit-- == 0) {
+          return;
+        }
+        fn(arenas[chunk.worker][index]);
+      }
+    }
+  }
+};
+
+#endif  // JNP1_BIRTH_ARENA_H
@@ -0,0 +1,30 @@
+#ifndef JNP1_COUNTER_RNG_H
+#define JNP1_COUNTER_RNG_H
+
+#include <cstdint>
+
+// Funkcja mieszająca z generatora splitmix64.
+constexpr uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+// Generator licznikowy: liczba losowa jest funkcją (seed, round, index), a nie
+// kolejnym stanem. Wątki nie dzielą więc żadnego stanu, każdą liczbę można
+// policzyć niezależnie od pozostałych, a wynik nie zależy od kolejności
+// obliczeń.
+class CounterRng {
+  uint64_t seed;
+
+ public:
+  constexpr explicit CounterRng(uint64_t seed) : seed(seed) {
+  }
+
+  constexpr uint64_t operator()(uint64_t round, uint64_t index) const {
+    return splitmix64(splitmix64(seed ^ splitmix64(round)) + index);
+  }
+};
+
+#endif  // JNP1_COUNTER_RNG_H
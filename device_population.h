@@ -0,0 +1,312 @@
+#ifndef JNP1_DEVICE_POPULATION_H
+#define JNP1_DEVICE_POPULATION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "encounter_counters.h"
+#include "encounter_kernel.h"
+#include "organism.h"
+#include "population.h"
+#include "species_registry.h"
+
+// Populacja trzymana w pamięci akceleratora (OpenMP target, np. GPU przez
+// -fopenmp -foffload=nvptx-none) przez wiele rund. Na akcelerator co rundę
+// idą tylko pary, a z powrotem liczba zabitych i opisy urodzonych dzieci;
+// całe kolumny są kopiowane tylko przy tworzeniu, powiększaniu i download.
+// Bez OpenMP (albo bez akceleratora) te same pętle liczą się na procesorze.
+
+#ifdef _OPENMP
+#define JNP1_OMP(directive) _Pragma(directive)
+#else
+#define JNP1_OMP(directive)
+#endif
+
+namespace {
+using std::unique_ptr;
+}  // namespace
+
+// Tablica o stałej pojemności z kopią w pamięci akceleratora. Kopia na
+// procesorze jest aktualna tylko po download.
+template <typename T>
+class DeviceColumn {
+  unique_ptr<T[]> host;
+  size_t capacity = 0;
+
+  void map() {
+    [[maybe_unused]] T *data = host.get();
+    [[maybe_unused]] const size_t length = capacity;
+    JNP1_OMP("omp target enter data map(alloc: data[0:length])")
+  }
+
+  void unmap() {
+    [[maybe_unused]] T *data = host.get();
+    [[maybe_unused]] const size_t length = capacity;
+    JNP1_OMP("omp target exit data map(delete: data[0:length])")
+  }
+
+ public:
+  explicit DeviceColumn(size_t capacity = 0)
+      : host(std::make_unique<T[]>(capacity)), capacity(capacity) {
+    map();
+  }
+
+  DeviceColumn(const DeviceColumn &) = delete;
+  DeviceColumn &operator=(const DeviceColumn &) = delete;
+
+  ~DeviceColumn() {
+    unmap();
+  }
+
+  size_t size() const {
+    return capacity;
+  }
+
+  // Wskaźnik do użycia w regionach target; wskazuje kopię na procesorze,
+  // a OpenMP podmienia go na adres kopii na akceleratorze.
+  T *data() const {
+    return host.get();
+  }
+
+  void upload(size_t begin, [[maybe_unused]] size_t count) {
+    [[maybe_unused]] T *data = host.get() + begin;
+    JNP1_OMP("omp target update to(data[0:count])")
+  }
+
+  void download(size_t begin, [[maybe_unused]] size_t count) {
+    [[maybe_unused]] T *data = host.get() + begin;
+    JNP1_OMP("omp target update from(data[0:count])")
+  }
+
+  // Nowa pojemność z zachowaniem pierwszych kept elementów.
+  void grow(size_t new_capacity, size_t kept) {
+    download(0, kept);
+    unmap();
+    auto moved = std::make_unique<T[]>(new_capacity);
+    std::copy(host.get(), host.get() + kept, moved.get());
+    host = std::move(moved);
+    capacity = new_capacity;
+    map();
+    upload(0, kept);
+  }
+};
+
+// Dziecko urodzone na akceleratorze w spotkaniu pary o numerze pair.
+struct device_birth {
+  uint64_t pair;
+  birth_record child;
+};
+
+// Populacja z kolumnami w pamięci akceleratora. Gatunki, carrying_capacity
+// i liczba martwych są na procesorze. Martwe organizmy zostają na swoich
+// miejscach; compact można wywołać na populacji z download. Jądro nie może
+// rzucać wyjątków, więc checked_vitality nie jest obsługiwana. Przy
+// JNP1_ORGANISM_COUNTERS liczone są tylko dzieci, bez reguł.
+template <typename species_t, vitality_policy policy_t = wrapping_vitality>
+requires(policy_t::overflow != VitalityOverflow::check) class DevicePopulation {
+  using vitality_type = typename policy_t::value_type;
+
+  SpeciesRegistry<species_t> registry;
+  size_t carrying_capacity;
+  size_t count;
+  size_t dead;
+  DeviceColumn<species_handle> species;
+  DeviceColumn<vitality_type> vitality;
+  DeviceColumn<Diet> diet;
+  DeviceColumn<device_birth> births;
+
+  void reserve(size_t needed) {
+    if (needed > species.size()) {
+      const size_t capacity = std::max(needed, 2 * species.size());
+      species.grow(capacity, count);
+      vitality.grow(capacity, count);
+      diet.grow(capacity, count);
+    }
+  }
+
+  // Spotkania par pair na akceleratorze. Zabitych dodaje do deaths, a dzieci
+  // wpisuje do born w przypadkowej kolejności i dodaje do born_count.
+  static void encounter_kernel(const encounter_pair_t *pair, size_t pair_count,
+                               const species_handle *species_ids,
+                               vitality_type *vitalities, const Diet *diets,
+                               device_birth *born, size_t &deaths,
+                               size_t &born_count) {
+    size_t kernel_deaths = 0;
+    size_t kernel_born = 0;
+    JNP1_OMP("omp target map(tofrom: kernel_deaths, kernel_born)")
+    JNP1_OMP("omp teams distribute parallel for reduction(+: kernel_deaths)")
+    for (size_t i = 0; i < pair_count; ++i) {
+      const population_index_t index1 = pair[i].first;
+      const population_index_t index2 = pair[i].second;
+      const Diet diet1 = diets[index1];
+      const Diet diet2 = diets[index2];
+      vitality_type v1 = vitalities[index1];
+      vitality_type v2 = vitalities[index2];
+      vitality_type child_vitality;
+      const bool has_child = encounter_lane<policy_t>(
+          v1, v2, diet1 == diet2 && species_ids[index1] == species_ids[index2],
+          diet_can_eat(diet1, diet2), diet_can_eat(diet2, diet1),
+          diet_is_plant(diet1), diet_is_plant(diet2), child_vitality);
+      kernel_deaths += (vitalities[index1] != 0 && v1 == 0) +
+                       (vitalities[index2] != 0 && v2 == 0);
+      vitalities[index1] = v1;
+      vitalities[index2] = v2;
+      if (has_child) {
+        size_t slot;
+        JNP1_OMP("omp atomic capture")
+        slot = kernel_born++;
+        born[slot] = {i, {species_ids[index1], diet1, child_vitality}};
+      }
+    }
+    deaths += kernel_deaths;
+    born_count += kernel_born;
+  }
+
+  // Czy któraś para to dwie rośliny; liczone na akceleratorze, bo tam są
+  // diety. Pary muszą już tam być.
+  bool has_two_plants(const encounter_pair_t *pair, size_t pair_count) const {
+    const Diet *diets = diet.data();
+    size_t plants = 0;
+    JNP1_OMP("omp target teams distribute parallel for reduction(+: plants)")
+    for (size_t i = 0; i < pair_count; ++i) {
+      plants += diet_is_plant(diets[pair[i].first]) &&
+                diet_is_plant(diets[pair[i].second]);
+    }
+    return plants != 0;
+  }
+
+ public:
+  // Kopia population na akceleratorze, z miejscem na capacity organizmów
+  // (co najmniej tyle, ile ma population).
+  explicit DevicePopulation(const Population<species_t, policy_t> &population,
+                            size_t capacity = 0)
+      : carrying_capacity(population.get_carrying_capacity()),
+        count(population.size()),
+        dead(population.dead_count()),
+        species(std::max(capacity, population.size())),
+        vitality(species.size()),
+        diet(species.size()) {
+    for (uint32_t id = 0; id < population.get_registry().size(); ++id) {
+      registry.intern(population.get_registry().get({id}));
+    }
+    std::ranges::copy(population.get_species_handles(), species.data());
+    std::ranges::copy(population.get_vitalities(), vitality.data());
+    std::ranges::copy(population.get_diets(), diet.data());
+    species.upload(0, count);
+    vitality.upload(0, count);
+    diet.upload(0, count);
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  size_t dead_count() const {
+    return dead;
+  }
+
+  size_t capacity() const {
+    return species.size();
+  }
+
+  // Seria spotkań rozłącznych par, liczona naraz na akceleratorze; wynik jest
+  // taki jak encounter_batch populacji z dziećmi dopisywanymi jak w
+  // add_births: w kolejności par i tylko do carrying_capacity. Pary muszą
+  // dotyczyć organizmów, które już są w populacji, i nie mogą mieć wspólnych
+  // organizmów (na akceleratorze liczą się naraz), inaczej rzucany jest
+  // invalid_argument, zanim cokolwiek się zmieni. Zwraca liczbę dopisanych.
+  size_t encounter_batch(span<const encounter_pair_t> pairs) {
+    for (const auto &[index1, index2] : pairs) {
+      if (index1 >= count || index2 >= count) {
+        throw out_of_range("Pair outside the population");
+      }
+    }
+    if (pairs_overlap(pairs, count)) {
+      throw std::invalid_argument("Pairs share an organism");
+    }
+    const encounter_pair_t *pair = pairs.data();
+    const size_t pair_count = pairs.size();
+    if (pair_count == 0) {
+      return 0;
+    }
+    if (births.size() < pair_count) {
+      births.grow(pair_count, 0);
+    }
+
+    species_handle *species_ids = species.data();
+    vitality_type *vitalities = vitality.data();
+    const Diet *diets = diet.data();
+    device_birth *born = births.data();
+    bool two_plants = false;
+    size_t deaths = 0;
+    size_t born_count = 0;
+    // Pary są przesyłane raz na oba jądra. Z bloku target data nie można
+    // wyjść wyjątkiem, więc błąd jest zgłaszany dopiero za nim.
+    JNP1_OMP("omp target data map(to: pair[0:pair_count])")
+    {
+      two_plants = has_two_plants(pair, pair_count);
+      if (!two_plants) {
+        encounter_kernel(pair, pair_count, species_ids, vitalities, diets,
+                         born, deaths, born_count);
+      }
+    }
+    if (two_plants) {
+      throw logic_error("Two plants cannot meet");
+    }
+    dead += deaths;
+
+    // Kolejność zapisów z atomic jest przypadkowa; dzieci są porządkowane
+    // według par na procesorze, bo jest ich zwykle znacznie mniej niż par.
+    births.download(0, born_count);
+    std::sort(born, born + born_count,
+              [](const device_birth &a, const device_birth &b) {
+                return a.pair < b.pair;
+              });
+    const size_t live = count - dead;
+    const size_t room =
+        live >= carrying_capacity ? 0 : carrying_capacity - live;
+    const size_t added = std::min(born_count, room);
+    births.upload(0, added);
+    reserve(count + added);
+
+    species_ids = species.data();
+    vitalities = vitality.data();
+    Diet *new_diets = diet.data();
+    const size_t first = count;
+    JNP1_OMP("omp target teams distribute parallel for")
+    for (size_t i = 0; i < added; ++i) {
+      species_ids[first + i] = born[i].child.species;
+      vitalities[first + i] =
+          static_cast<vitality_type>(born[i].child.vitality);
+      new_diets[first + i] = born[i].child.diet;
+    }
+    count += added;
+    // Tak jak w encounter_batch populacji liczą się też dzieci, które nie
+    // zmieściły się do carrying_capacity.
+    count_offspring(born_count);
+    return added;
+  }
+
+  // Populacja na procesorze z aktualnymi kolumnami.
+  Population<species_t, policy_t> download() {
+    species.download(0, count);
+    vitality.download(0, count);
+    diet.download(0, count);
+    Population<species_t, policy_t> population;
+    for (uint32_t id = 0; id < registry.size(); ++id) {
+      population.intern_species(registry.get({id}));
+    }
+    population.set_carrying_capacity(carrying_capacity);
+    population.append(span(species.data(), count),
+                      span<const vitality_type>(vitality.data(), count),
+                      span(diet.data(), count));
+    return population;
+  }
+};
+
+#endif  // JNP1_DEVICE_POPULATION_H
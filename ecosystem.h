@@ -0,0 +1,154 @@
+#ifndef JNP1_ECOSYSTEM_H
+#define JNP1_ECOSYSTEM_H
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "any_organism.h"
+#include "organism.h"
+
+namespace {
+using ecosystem_pair_t = std::pair<size_t, size_t>;
+using std::out_of_range, std::length_error;
+}  // namespace
+
+// Zbiór organizmów o stałej pojemności, w całości constexpr: można go
+// zbudować i przeliczyć w czasie kompilacji, a wynik zapisać w zmiennej
+// constexpr, więc gotowe scenariusze nie kosztują nic przy starcie programu.
+// Organizmy są przechowywane kolumnami jak w Population, ale bez rejestru
+// gatunków; martwe zostają na swoich miejscach, więc numery się nie zmieniają.
+template <typename species_t, size_t capacity,
+          vitality_policy policy_t = wrapping_vitality>
+requires equality_comparable<species_t> && std::default_initializable<species_t>
+class Ecosystem {
+ public:
+  using vitality_type = typename policy_t::value_type;
+
+ private:
+  std::array<species_t, capacity> species{};
+  std::array<Diet, capacity> diet{};
+  std::array<vitality_type, capacity> vitality{};
+  size_t used = 0;
+
+  constexpr void check_index(size_t index) const {
+    if (index >= used) {
+      throw out_of_range("Unknown organism");
+    }
+  }
+
+ public:
+  constexpr Ecosystem() = default;
+
+  // Organizmy mogą mieć inną politykę niż ekosystem; witalności większe niż
+  // vitality_max polityki ekosystemu rzucają out_of_range zamiast się
+  // obcinać.
+  template <typename organism_policy_t, size_t count>
+  constexpr explicit Ecosystem(
+      const std::array<AnyOrganism<species_t, organism_policy_t>, count>
+          &organisms) {
+    static_assert(count <= capacity);
+    for (const auto &organism : organisms) {
+      if (organism.get_vitality() > vitality_max<policy_t>()) {
+        throw out_of_range("Vitality does not fit in the ecosystem");
+      }
+      add(organism.get_species(), organism.get_diet(),
+          static_cast<vitality_type>(organism.get_vitality()));
+    }
+  }
+
+  constexpr size_t size() const {
+    return used;
+  }
+
+  constexpr size_t add(species_t const &new_species, Diet new_diet,
+                       vitality_type new_vitality) {
+    if (used == capacity) {
+      throw length_error("Ecosystem is full");
+    }
+    if (new_vitality > vitality_max<policy_t>()) {
+      throw out_of_range("Vitality does not fit in the ecosystem");
+    }
+    species[used] = new_species;
+    diet[used] = new_diet;
+    vitality[used] = new_vitality;
+    return used++;
+  }
+
+  template <bool can_eat_meat, bool can_eat_plants>
+  constexpr size_t add(
+      Organism<species_t, can_eat_meat, can_eat_plants, policy_t> const
+          &organism) {
+    return add(organism.get_species(), organism.diet, organism.get_vitality());
+  }
+
+  constexpr const species_t &get_species(size_t index) const {
+    check_index(index);
+    return species[index];
+  }
+
+  constexpr Diet get_diet(size_t index) const {
+    check_index(index);
+    return diet[index];
+  }
+
+  constexpr vitality_type get_vitality(size_t index) const {
+    check_index(index);
+    return vitality[index];
+  }
+
+  constexpr bool is_dead(size_t index) const {
+    return get_vitality(index) == 0;
+  }
+
+  // Runda spotkań par z pairs (dowolny zakres par numerów), w kolejności.
+  // Dzieci są dopisywane na końcu rundy, w kolejności par, więc pary mogą
+  // dotyczyć tylko organizmów sprzed rundy. Para organizmu z samym sobą jest
+  // spotkaniem jak w encounter_batch populacji: ten sam gatunek (reguła 4),
+  // a dla rośliny logic_error. Zwraca liczbę urodzonych.
+  template <typename round_t>
+  constexpr size_t encounter_round(const round_t &pairs) {
+    std::vector<std::pair<size_t, vitality_type>> births;
+    for (const auto &[index1, index2] : pairs) {
+      check_index(index1);
+      check_index(index2);
+      const auto outcome = encounter_outcome_of<policy_t>(
+          diet[index1], diet[index2], species[index1] == species[index2],
+          vitality[index1], vitality[index2]);
+      vitality[index1] = outcome.vitality1;
+      vitality[index2] = outcome.vitality2;
+      if (outcome.has_child) {
+        births.emplace_back(index1, outcome.child_vitality);
+        count_offspring();
+      }
+    }
+    for (const auto &[parent, child_vitality] : births) {
+      add(species[parent], diet[parent], child_vitality);
+    }
+    return births.size();
+  }
+};
+
+// Cała symulacja: organizmy z organisms spotykają się runda po rundzie według
+// schedule (zakres rund, z których każda jest zakresem par numerów). Wynik
+// mieści co najwyżej capacity organizmów razem z dziećmi; przekroczenie
+// pojemności rzuca length_error, a w czasie kompilacji jest błędem kompilacji.
+// Witalności liczy polityka policy_t.
+template <size_t capacity, vitality_policy policy_t = wrapping_vitality,
+          typename species_t, typename organism_policy_t, size_t count,
+          typename schedule_t>
+constexpr Ecosystem<species_t, capacity, policy_t> simulate(
+    const std::array<AnyOrganism<species_t, organism_policy_t>, count>
+        &organisms,
+    const schedule_t &schedule) {
+  Ecosystem<species_t, capacity, policy_t> ecosystem(organisms);
+  for (const auto &round : schedule) {
+    ecosystem.encounter_round(round);
+  }
+  return ecosystem;
+}
+
+#endif  // JNP1_ECOSYSTEM_H
@@ -0,0 +1,182 @@
+#ifndef JNP1_ENCOUNTER_COUNTERS_H
+#define JNP1_ENCOUNTER_COUNTERS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#ifdef JNP1_ORGANISM_COUNTERS
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#endif
+
+// Liczniki reguł, które rozstrzygnęły spotkania, i urodzonych dzieci.
+// Włączane przy kompilacji makrem JNP1_ORGANISM_COUNTERS (opcja CMake
+// JNP1_ORGANISM_COUNTERS); bez niego count_* są pustymi funkcjami constexpr
+// i znikają z kodu. Każdy wątek liczy we własnym bloku zajmującym osobną linię
+// pamięci podręcznej, a encounter_counters sumuje bloki dopiero na żądanie.
+// Podczas obliczeń w czasie kompilacji nic nie jest liczone.
+
+enum class EncounterRule : uint8_t {
+  dead,             // 3. Jedna ze stron jest martwa.
+  same_species,     // 4. Ten sam gatunek.
+  inert,            // 5. Nikt nikogo nie zje.
+  mutual,           // 6. Walka.
+  plant_eaten,      // 7. Roślina zostaje zjedzona.
+  one_way_success,  // 8. Zjadający jest silniejszy.
+  one_way_fail,     // 8. Zjadający nie jest silniejszy.
+};
+
+inline constexpr size_t encounter_rule_count = 7;
+
+// Zsumowane liczniki wszystkich wątków.
+struct encounter_counts {
+  std::array<uint64_t, encounter_rule_count> rules{};
+  uint64_t offspring = 0;
+
+  constexpr uint64_t operator[](EncounterRule rule) const {
+    return rules[static_cast<size_t>(rule)];
+  }
+
+  constexpr uint64_t encounters() const {
+    uint64_t total = 0;
+    for (const uint64_t count : rules) {
+      total += count;
+    }
+    return total;
+  }
+};
+
+#ifdef JNP1_ORGANISM_COUNTERS
+
+inline constexpr bool encounter_counters_enabled = true;
+
+// Liczniki jednego wątku. Pisze do nich tylko ten wątek, więc zwiększanie to
+// zwykły odczyt i zapis; atomowość jest potrzebna tylko sumowaniu z innego
+// wątku.
+struct alignas(64) encounter_counter_block {
+  std::array<std::atomic<uint64_t>, encounter_rule_count + 1> counts{};
+
+  void add(size_t counter, uint64_t count) {
+    counts[counter].store(
+        counts[counter].load(std::memory_order_relaxed) + count,
+        std::memory_order_relaxed);
+  }
+
+  void add_to(encounter_counts &total) const {
+    for (size_t rule = 0; rule < encounter_rule_count; ++rule) {
+      total.rules[rule] += counts[rule].load(std::memory_order_relaxed);
+    }
+    total.offspring +=
+        counts[encounter_rule_count].load(std::memory_order_relaxed);
+  }
+
+  void clear() {
+    for (auto &count : counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+// Bloki żyjących wątków i suma liczników wątków, które już się zakończyły.
+class EncounterCounterRegistry {
+  std::mutex mutex;
+  std::vector<encounter_counter_block *> blocks;
+  encounter_counts retired;
+
+ public:
+  static EncounterCounterRegistry &instance() {
+    static EncounterCounterRegistry registry;
+    return registry;
+  }
+
+  void attach(encounter_counter_block *block) {
+    std::lock_guard lock(mutex);
+    blocks.push_back(block);
+  }
+
+  void detach(encounter_counter_block *block) {
+    std::lock_guard lock(mutex);
+    block->add_to(retired);
+    blocks.erase(std::find(blocks.begin(), blocks.end(), block));
+  }
+
+  encounter_counts total() {
+    std::lock_guard lock(mutex);
+    encounter_counts sum = retired;
+    for (const auto *block : blocks) {
+      block->add_to(sum);
+    }
+    return sum;
+  }
+
+  void clear() {
+    std::lock_guard lock(mutex);
+    retired = {};
+    for (auto *block : blocks) {
+      block->clear();
+    }
+  }
+};
+
+struct encounter_counter_owner {
+  encounter_counter_block block;
+
+  encounter_counter_owner() {
+    EncounterCounterRegistry::instance().attach(&block);
+  }
+
+  ~encounter_counter_owner() {
+    EncounterCounterRegistry::instance().detach(&block);
+  }
+};
+
+inline encounter_counter_block &local_encounter_counters() {
+  thread_local encounter_counter_owner owner;
+  return owner.block;
+}
+
+inline encounter_counts encounter_counters() {
+  return EncounterCounterRegistry::instance().total();
+}
+
+// Zeruje liczniki; nie powinno się wtedy liczyć żadnych spotkań.
+inline void reset_encounter_counters() {
+  EncounterCounterRegistry::instance().clear();
+}
+
+constexpr void count_encounter_rule(EncounterRule rule, uint64_t count = 1) {
+  if (!std::is_constant_evaluated()) {
+    local_encounter_counters().add(static_cast<size_t>(rule), count);
+  }
+}
+
+constexpr void count_offspring(uint64_t count = 1) {
+  if (!std::is_constant_evaluated()) {
+    local_encounter_counters().add(encounter_rule_count, count);
+  }
+}
+
+#else
+
+inline constexpr bool encounter_counters_enabled = false;
+
+inline encounter_counts encounter_counters() {
+  return {};
+}
+
+inline void reset_encounter_counters() {
+}
+
+constexpr void count_encounter_rule(EncounterRule, uint64_t = 1) {
+}
+
+constexpr void count_offspring(uint64_t = 1) {
+}
+
+#endif  // JNP1_ORGANISM_COUNTERS
+
+#endif  // JNP1_ENCOUNTER_COUNTERS_H
@@ -0,0 +1,343 @@
+#ifndef JNP1_ENCOUNTER_KERNEL_H
+#define JNP1_ENCOUNTER_KERNEL_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "organism.h"
+
+// Reguły 3-8 bez rozgałęzień, dla kilku rozłącznych spotkań naraz. Wszystko,
+// co zależy tylko od gatunków i diet, jest liczone wcześniej i podawane jako
+// maski bitowe (bit i odpowiada i-temu spotkaniu w grupie), a jądro zajmuje się
+// już tylko porównaniami i dodawaniem witalności.
+
+#if defined(__AVX512F__)
+inline constexpr size_t encounter_lanes = 8;
+#else
+inline constexpr size_t encounter_lanes = 4;
+#endif
+
+struct encounter_lane_flags {
+  uint8_t same_species = 0;  // Reguła 4.
+  uint8_t eats1 = 0;         // Pierwszy potrafi zjeść drugiego.
+  uint8_t eats2 = 0;         // Drugi potrafi zjeść pierwszego.
+  uint8_t plant1 = 0;        // Pierwszy jest rośliną (reguła 7).
+  uint8_t plant2 = 0;        // Drugi jest rośliną (reguła 7).
+};
+
+// Jedno spotkanie; dla witalności v1, v2 zwraca nowe witalności w v1, v2.
+template <vitality_policy policy_t = wrapping_vitality,
+          typename vitality_type = typename policy_t::value_type>
+constexpr bool encounter_lane(vitality_type &v1, vitality_type &v2,
+                              bool same_species, bool eats1, bool eats2,
+                              bool plant1, bool plant2,
+                              vitality_type &child_vitality) {
+  const bool alive = v1 != 0 && v2 != 0;
+  const bool acts = alive && !same_species;
+  const bool mutual_tie = eats1 && eats2 && v1 == v2;
+  const bool win1 = acts && eats1 && (plant2 || v2 < v1);
+  const bool win2 = acts && eats2 && (plant1 || v1 < v2);
+  const bool die1 = win2 || (acts && mutual_tie);
+  const bool die2 = win1 || (acts && mutual_tie);
+  const vitality_type zero = 0;
+  const vitality_type gain1 = plant2 ? v2 : v2 / 2;
+  const vitality_type gain2 = plant1 ? v1 : v1 / 2;
+
+  child_vitality = policy_t::mean(v1, v2);
+  const vitality_type new_v1 =
+      die1 ? zero : policy_t::add(v1, win1 ? gain1 : zero);
+  const vitality_type new_v2 =
+      die2 ? zero : policy_t::add(v2, win2 ? gain2 : zero);
+  v1 = new_v1;
+  v2 = new_v2;
+  return alive && same_species;
+}
+
+// Reguła, która rozstrzygnie spotkanie liczone przez encounter_lane, dla
+// liczników z encounter_counters.h.
+constexpr EncounterRule encounter_lane_rule(vitality_t v1, vitality_t v2,
+                                            bool same_species, bool eats1,
+                                            bool eats2, bool plant1,
+                                            bool plant2) {
+  if (v1 == 0 || v2 == 0) {
+    return EncounterRule::dead;
+  }
+  if (same_species) {
+    return EncounterRule::same_species;
+  }
+  if (!eats1 && !eats2) {
+    return EncounterRule::inert;
+  }
+  if (eats1 && eats2) {
+    return EncounterRule::mutual;
+  }
+  if (plant1 || plant2) {
+    return EncounterRule::plant_eaten;
+  }
+  return (eats1 ? v2 < v1 : v1 < v2) ? EncounterRule::one_way_success
+                                     : EncounterRule::one_way_fail;
+}
+
+// Wersja skalarna; zwraca maskę spotkań, w których urodziło się dziecko,
+// a do deaths dodaje liczbę organizmów, które zginęły.
+template <vitality_policy policy_t = wrapping_vitality,
+          typename vitality_type = typename policy_t::value_type>
+constexpr uint8_t encounter_group_scalar(vitality_type *vitality,
+                                         const uint64_t *index1,
+                                         const uint64_t *index2,
+                                         encounter_lane_flags flags,
+                                         vitality_type *child_vitality,
+                                         size_t &deaths) {
+  uint8_t born = 0;
+  for (size_t lane = 0; lane < encounter_lanes; ++lane) {
+    auto bit = [lane](uint8_t mask) {
+      return ((mask >> lane) & 1) != 0;
+    };
+    vitality_type v1 = vitality[index1[lane]];
+    vitality_type v2 = vitality[index2[lane]];
+    const bool alive1 = v1 != 0;
+    const bool alive2 = v2 != 0;
+    born |= encounter_lane<policy_t>(v1, v2, bit(flags.same_species),
+                                     bit(flags.eats1), bit(flags.eats2),
+                                     bit(flags.plant1), bit(flags.plant2),
+                                     child_vitality[lane])
+            << lane;
+    vitality[index1[lane]] = v1;
+    vitality[index2[lane]] = v2;
+    deaths += (alive1 && v1 == 0) + (alive2 && v2 == 0);
+  }
+  return born;
+}
+
+#if defined(__AVX512F__)
+
+namespace {
+// Wersje z maską, bo bez niej GCC ostrzega o niezainicjalizowanych rejestrach.
+constexpr __mmask8 all_lanes = 0xFF;
+
+inline __m512i half_epu64(__m512i v) {
+  return _mm512_maskz_srli_epi64(all_lanes, v, 1);
+}
+
+inline __m512i gather_epu64(const vitality_t *base, __m512i index) {
+  return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), all_lanes, index,
+                                     base, 8);
+}
+
+// a + b w polach z maski, według policy_t. Sprawdzanie jest tu nasycaniem,
+// bo wołający wyklucza przepełnienie, zanim odda grupę do jądra.
+template <typename policy_t>
+inline __m512i add_epu64(__m512i a, __mmask8 mask, __m512i b) {
+  const __m512i sum = _mm512_mask_add_epi64(a, mask, a, b);
+  if constexpr (policy_t::overflow == VitalityOverflow::wrap) {
+    return sum;
+  } else {
+    return _mm512_mask_mov_epi64(sum, _mm512_cmplt_epu64_mask(sum, a),
+                                 _mm512_set1_epi64(-1));
+  }
+}
+
+template <typename policy_t>
+inline __m512i mean_epu64(__m512i a, __m512i b) {
+  if constexpr (policy_t::overflow == VitalityOverflow::wrap) {
+    return half_epu64(_mm512_add_epi64(a, b));
+  } else {
+    return _mm512_add_epi64(
+        _mm512_add_epi64(half_epu64(a), half_epu64(b)),
+        _mm512_and_si512(_mm512_and_si512(a, b), _mm512_set1_epi64(1)));
+  }
+}
+}  // namespace
+
+template <vitality_policy policy_t = wrapping_vitality>
+inline uint8_t encounter_group_simd64(vitality_t *vitality,
+                                      const uint64_t *index1,
+                                      const uint64_t *index2,
+                                      encounter_lane_flags flags,
+                                      vitality_t *child_vitality,
+                                      size_t &deaths) {
+  const __m512i i1 = _mm512_loadu_si512(index1);
+  const __m512i i2 = _mm512_loadu_si512(index2);
+  const __m512i v1 = gather_epu64(vitality, i1);
+  const __m512i v2 = gather_epu64(vitality, i2);
+  const __m512i zero = _mm512_setzero_si512();
+
+  const __mmask8 alive = _mm512_cmpneq_epu64_mask(v1, zero) &
+                         _mm512_cmpneq_epu64_mask(v2, zero);
+  const __mmask8 acts = alive & ~flags.same_species;
+  const __mmask8 mutual_tie =
+      flags.eats1 & flags.eats2 & _mm512_cmpeq_epu64_mask(v1, v2);
+  const __mmask8 win1 =
+      acts & flags.eats1 & (flags.plant2 | _mm512_cmplt_epu64_mask(v2, v1));
+  const __mmask8 win2 =
+      acts & flags.eats2 & (flags.plant1 | _mm512_cmplt_epu64_mask(v1, v2));
+  const __mmask8 die1 = win2 | (acts & mutual_tie);
+  const __mmask8 die2 = win1 | (acts & mutual_tie);
+
+  const __m512i gain1 =
+      _mm512_mask_blend_epi64(flags.plant2, half_epu64(v2), v2);
+  const __m512i gain2 =
+      _mm512_mask_blend_epi64(flags.plant1, half_epu64(v1), v1);
+  const __m512i new_v1 =
+      _mm512_maskz_mov_epi64(~die1, add_epu64<policy_t>(v1, win1, gain1));
+  const __m512i new_v2 =
+      _mm512_maskz_mov_epi64(~die2, add_epu64<policy_t>(v2, win2, gain2));
+
+  _mm512_storeu_si512(child_vitality, mean_epu64<policy_t>(v1, v2));
+  _mm512_i64scatter_epi64(vitality, i1, new_v1, 8);
+  _mm512_i64scatter_epi64(vitality, i2, new_v2, 8);
+  deaths += std::popcount(static_cast<unsigned>(die1)) +
+            std::popcount(static_cast<unsigned>(die2));
+  return alive & flags.same_species;
+}
+
+#elif defined(__AVX2__)
+
+namespace {
+// Rozwinięcie maski bitowej do masek na całych 64-bitowych polach.
+inline __m256i expand_lane_mask(uint8_t mask) {
+  const __m256i bits = _mm256_set_epi64x(8, 4, 2, 1);
+  return _mm256_cmpeq_epi64(
+      _mm256_and_si256(_mm256_set1_epi64x(mask), bits), bits);
+}
+
+// AVX2 porównuje tylko liczby ze znakiem.
+inline __m256i cmplt_epu64(__m256i a, __m256i b) {
+  const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+  return _mm256_cmpgt_epi64(_mm256_xor_si256(b, sign),
+                            _mm256_xor_si256(a, sign));
+}
+
+// a + b według policy_t, jak w wersji AVX-512.
+template <typename policy_t>
+inline __m256i add_epu64(__m256i a, __m256i b) {
+  const __m256i sum = _mm256_add_epi64(a, b);
+  if constexpr (policy_t::overflow == VitalityOverflow::wrap) {
+    return sum;
+  } else {
+    return _mm256_or_si256(sum, cmplt_epu64(sum, a));
+  }
+}
+
+template <typename policy_t>
+inline __m256i mean_epu64(__m256i a, __m256i b) {
+  if constexpr (policy_t::overflow == VitalityOverflow::wrap) {
+    return _mm256_srli_epi64(_mm256_add_epi64(a, b), 1);
+  } else {
+    return _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_srli_epi64(a, 1), _mm256_srli_epi64(b, 1)),
+        _mm256_and_si256(_mm256_and_si256(a, b), _mm256_set1_epi64x(1)));
+  }
+}
+}  // namespace
+
+template <vitality_policy policy_t = wrapping_vitality>
+inline uint8_t encounter_group_simd64(vitality_t *vitality,
+                                      const uint64_t *index1,
+                                      const uint64_t *index2,
+                                      encounter_lane_flags flags,
+                                      vitality_t *child_vitality,
+                                      size_t &deaths) {
+  const auto *base = reinterpret_cast<const long long *>(vitality);
+  const __m256i i1 =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(index1));
+  const __m256i i2 =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(index2));
+  const __m256i v1 = _mm256_i64gather_epi64(base, i1, 8);
+  const __m256i v2 = _mm256_i64gather_epi64(base, i2, 8);
+  const __m256i zero = _mm256_setzero_si256();
+
+  const __m256i same = expand_lane_mask(flags.same_species);
+  const __m256i eats1 = expand_lane_mask(flags.eats1);
+  const __m256i eats2 = expand_lane_mask(flags.eats2);
+  const __m256i plant1 = expand_lane_mask(flags.plant1);
+  const __m256i plant2 = expand_lane_mask(flags.plant2);
+
+  // dead = v1 == 0 || v2 == 0
+  const __m256i dead = _mm256_or_si256(_mm256_cmpeq_epi64(v1, zero),
+                                       _mm256_cmpeq_epi64(v2, zero));
+  const __m256i acts = _mm256_andnot_si256(_mm256_or_si256(dead, same),
+                                           _mm256_set1_epi64x(-1));
+  const __m256i mutual_tie = _mm256_and_si256(
+      _mm256_and_si256(eats1, eats2), _mm256_cmpeq_epi64(v1, v2));
+  const __m256i win1 = _mm256_and_si256(
+      _mm256_and_si256(acts, eats1),
+      _mm256_or_si256(plant2, cmplt_epu64(v2, v1)));
+  const __m256i win2 = _mm256_and_si256(
+      _mm256_and_si256(acts, eats2),
+      _mm256_or_si256(plant1, cmplt_epu64(v1, v2)));
+  const __m256i tie = _mm256_and_si256(acts, mutual_tie);
+  const __m256i die1 = _mm256_or_si256(win2, tie);
+  const __m256i die2 = _mm256_or_si256(win1, tie);
+
+  const __m256i gain1 =
+      _mm256_blendv_epi8(_mm256_srli_epi64(v2, 1), v2, plant2);
+  const __m256i gain2 =
+      _mm256_blendv_epi8(_mm256_srli_epi64(v1, 1), v1, plant1);
+  const __m256i new_v1 = _mm256_andnot_si256(
+      die1, add_epu64<policy_t>(v1, _mm256_and_si256(win1, gain1)));
+  const __m256i new_v2 = _mm256_andnot_si256(
+      die2, add_epu64<policy_t>(v2, _mm256_and_si256(win2, gain2)));
+
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(child_vitality),
+                      mean_epu64<policy_t>(v1, v2));
+  alignas(32) vitality_t out1[encounter_lanes];
+  alignas(32) vitality_t out2[encounter_lanes];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(out1), new_v1);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(out2), new_v2);
+  for (size_t lane = 0; lane < encounter_lanes; ++lane) {
+    vitality[index1[lane]] = out1[lane];
+    vitality[index2[lane]] = out2[lane];
+  }
+  deaths += std::popcount(static_cast<unsigned>(
+                _mm256_movemask_pd(_mm256_castsi256_pd(die1)))) +
+            std::popcount(static_cast<unsigned>(
+                _mm256_movemask_pd(_mm256_castsi256_pd(die2))));
+  const int alive_mask =
+      ~_mm256_movemask_pd(_mm256_castsi256_pd(dead)) & 0b1111;
+  return static_cast<uint8_t>(alive_mask & flags.same_species);
+}
+
+#else
+
+template <vitality_policy policy_t = wrapping_vitality>
+inline uint8_t encounter_group_simd64(vitality_t *vitality,
+                                      const uint64_t *index1,
+                                      const uint64_t *index2,
+                                      encounter_lane_flags flags,
+                                      vitality_t *child_vitality,
+                                      size_t &deaths) {
+  return encounter_group_scalar<policy_t>(vitality, index1, index2, flags,
+                                          child_vitality, deaths);
+}
+
+#endif
+
+// Jądra wektorowe są napisane dla 64-bitowych witalności z pełnym zakresem;
+// węższe witalności i polityki z mniejszym vitality_max idą przez wersję
+// skalarną (też bez rozgałęzień, więc kompilator może ją zwektoryzować sam).
+template <vitality_policy policy_t = wrapping_vitality,
+          typename vitality_type = typename policy_t::value_type>
+inline uint8_t encounter_group_simd(vitality_type *vitality,
+                                    const uint64_t *index1,
+                                    const uint64_t *index2,
+                                    encounter_lane_flags flags,
+                                    vitality_type *child_vitality,
+                                    size_t &deaths) {
+  if constexpr (std::is_same_v<vitality_type, vitality_t> &&
+                vitality_max<policy_t>() == UINT64_MAX) {
+    return encounter_group_simd64<policy_t>(vitality, index1, index2, flags,
+                                            child_vitality, deaths);
+  } else {
+    return encounter_group_scalar<policy_t>(vitality, index1, index2, flags,
+                                            child_vitality, deaths);
+  }
+}
+
+#endif  // JNP1_ENCOUNTER_KERNEL_H
@@ -0,0 +1,236 @@
+#ifndef JNP1_EVENT_LOG_H
+#define JNP1_EVENT_LOG_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "encounter_counters.h"
+#include "organism.h"
+#include "population.h"
+#include "thread_pool.h"
+
+// Zapis skutków spotkań do pliku. Wątki symulacji wpisują zdarzenia do
+// własnych buforów cyklicznych (jeden producent i jeden konsument, bez
+// blokad), a osobny wątek zapisujący opróżnia je paczkami jednym wywołaniem
+// write na paczkę. Wpis zdarzenia to kilka zapisów do pamięci; jeśli bufor
+// jest pełny, wątek symulacji czeka na wątek zapisujący, więc zdarzenia nigdy
+// nie giną. Zdarzenia jednego wątku trafiają do pliku w kolejności, a zdarzenia
+// różnych wątków są przeplecione; kolejność spotkań odtwarza się z round
+// i numerów organizmów.
+
+// Rekord w pliku: 32 bajty, little-endian (w kolejności bajtów procesora).
+struct encounter_event {
+  uint32_t round;
+  uint32_t index1;
+  uint32_t index2;
+  EncounterRule rule;
+  bool has_child;
+  uint16_t reserved;
+  uint64_t vitality1;
+  uint64_t vitality2;
+};
+
+static_assert(sizeof(encounter_event) == 32);
+static_assert(std::is_trivially_copyable_v<encounter_event>);
+
+class EncounterEventLog {
+  // Bufor jednego wątku symulacji. head zmienia tylko producent, tail tylko
+  // wątek zapisujący; każdy trzyma też ostatnio widzianą wartość drugiego
+  // licznika, żeby nie czytać cudzej linii pamięci przy każdym zdarzeniu.
+  struct alignas(64) event_ring {
+    std::unique_ptr<encounter_event[]> events;
+    alignas(64) std::atomic<size_t> head = 0;
+    size_t cached_tail = 0;
+    alignas(64) std::atomic<size_t> tail = 0;
+  };
+
+  static constexpr size_t batch_size = 4096;
+  static constexpr auto idle_wait = std::chrono::microseconds(200);
+
+  int fd;
+  size_t ring_mask;
+  std::unique_ptr<event_ring[]> rings;
+  size_t ring_count;
+  std::atomic<bool> stopping = false;
+  std::atomic<uint64_t> written = 0;
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  std::thread writer;
+
+  void write_all(const encounter_event *events, size_t count) {
+    const char *data = reinterpret_cast<const char *>(events);
+    size_t left = count * sizeof(encounter_event);
+    while (left > 0) {
+      const ssize_t result = ::write(fd, data, left);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(),
+                                "Cannot write encounter events");
+      }
+      data += result;
+      left -= static_cast<size_t>(result);
+    }
+  }
+
+  // Przenosi do pliku wszystko, co jest w buforach; zwraca liczbę zdarzeń.
+  size_t drain(vector<encounter_event> &batch) {
+    size_t drained = 0;
+    for (size_t i = 0; i < ring_count; ++i) {
+      event_ring &ring = rings[i];
+      const size_t head = ring.head.load(std::memory_order_acquire);
+      size_t tail = ring.tail.load(std::memory_order_relaxed);
+      while (tail != head) {
+        batch.push_back(ring.events[tail & ring_mask]);
+        ++tail;
+        if (batch.size() == batch_size || tail == head) {
+          write_all(batch.data(), batch.size());
+          drained += batch.size();
+          batch.clear();
+          ring.tail.store(tail, std::memory_order_release);
+        }
+      }
+    }
+    written.fetch_add(drained, std::memory_order_release);
+    return drained;
+  }
+
+  void run() {
+    vector<encounter_event> batch;
+    batch.reserve(batch_size);
+    try {
+      while (!stopping.load(std::memory_order_acquire)) {
+        if (drain(batch) == 0) {
+          std::this_thread::sleep_for(idle_wait);
+        }
+      }
+      drain(batch);
+    } catch (...) {
+      std::lock_guard lock(error_mutex);
+      error = std::current_exception();
+    }
+  }
+
+  bool failed() {
+    std::lock_guard lock(error_mutex);
+    return error != nullptr;
+  }
+
+ public:
+  // Dziennik dopisywany do path (plik jest tworzony albo czyszczony), z ring_
+  // count buforami po ring_capacity zdarzeń (zaokrąglone w górę do potęgi
+  // dwójki). Potrzeba co najmniej tylu buforów, ile wątków ma pula.
+  EncounterEventLog(const std::string &path, size_t ring_count,
+                    size_t ring_capacity = 1 << 14)
+      : ring_count(ring_count) {
+    if (ring_count == 0 || ring_capacity == 0) {
+      throw invalid_argument("Event log needs at least one ring");
+    }
+    size_t capacity = 1;
+    while (capacity < ring_capacity) {
+      capacity *= 2;
+    }
+    ring_mask = capacity - 1;
+    rings = std::make_unique<event_ring[]>(ring_count);
+    for (size_t i = 0; i < ring_count; ++i) {
+      rings[i].events = std::make_unique<encounter_event[]>(capacity);
+    }
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+    writer = std::thread([this] { run(); });
+  }
+
+  EncounterEventLog(const EncounterEventLog &) = delete;
+  EncounterEventLog &operator=(const EncounterEventLog &) = delete;
+
+  // Zapisuje pozostałe zdarzenia i zamyka plik. Błąd zapisu, którego nie
+  // zgłosiło wcześniej flush, przepada.
+  ~EncounterEventLog() {
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    ::close(fd);
+  }
+
+  size_t size() const {
+    return ring_count;
+  }
+
+  // Wpisuje zdarzenie do bufora wątku worker. Dla danego worker wołane
+  // zawsze z jednego wątku naraz.
+  void push(size_t worker, const encounter_event &event) {
+    event_ring &ring = rings[worker];
+    const size_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.cached_tail > ring_mask) {
+      ring.cached_tail = ring.tail.load(std::memory_order_acquire);
+      while (head - ring.cached_tail > ring_mask) {
+        if (failed()) {
+          throw logic_error("Encounter event writer has failed");
+        }
+        std::this_thread::yield();
+        ring.cached_tail = ring.tail.load(std::memory_order_acquire);
+      }
+    }
+    ring.events[head & ring_mask] = event;
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+  // Liczba zdarzeń zapisanych do pliku.
+  uint64_t written_count() const {
+    return written.load(std::memory_order_acquire);
+  }
+
+  // Czeka, aż wszystkie wpisane dotąd zdarzenia znajdą się w pliku; rzuca
+  // błąd wątku zapisującego. Wołane, gdy nie trwa żadna runda.
+  void flush() {
+    uint64_t pushed = 0;
+    for (size_t i = 0; i < ring_count; ++i) {
+      pushed += rings[i].head.load(std::memory_order_relaxed);
+    }
+    while (written_count() < pushed) {
+      if (failed()) {
+        break;
+      }
+      std::this_thread::yield();
+    }
+    std::lock_guard lock(error_mutex);
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // Obserwator dla encounter_round, zapisujący spotkania rundy round. Rekord
+  // mieści numery rund do UINT32_MAX; dalsze rzucają out_of_range.
+  auto recorder(uint64_t round, const ThreadPool &pool) {
+    if (pool.size() > ring_count) {
+      throw invalid_argument("Event log has fewer rings than the pool");
+    }
+    if (round > UINT32_MAX) {
+      throw std::out_of_range("Round does not fit in an event record");
+    }
+    return [this, round = static_cast<uint32_t>(round)](
+               size_t worker, population_index_t index1,
+               population_index_t index2, const auto &outcome) {
+      push(worker, {round, index1, index2, outcome.rule, outcome.has_child, 0,
+                    outcome.vitality1, outcome.vitality2});
+    };
+  }
+};
+
+#endif  // JNP1_EVENT_LOG_H
@@ -1,42 +1,224 @@
 #ifndef JNP1_ORGANISM_H
 #define JNP1_ORGANISM_H
 
+#include <array>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <optional>
 #include <stdexcept>
 #include <tuple>
 #include <type_traits>
+#include <utility>
+
+#include "encounter_counters.h"
 
 namespace {
 using vitality_t = uint64_t;
-using std::nullopt, std::optional, std::tuple, std::logic_error, std::get,
-    std::equality_comparable;
+using std::optional, std::tuple, std::logic_error, std::overflow_error,
+    std::get, std::equality_comparable;
 }  // namespace
 
-template <typename species_t, bool can_eat_meat, bool can_eat_plants>
+// Preferencje żywieniowe zakodowane na dwóch bitach (mięso, rośliny), dla kodu,
+// który zna je dopiero w czasie wykonania.
+enum class Diet : uint8_t {
+  plant = 0b00,
+  herbivore = 0b01,
+  carnivore = 0b10,
+  omnivore = 0b11,
+};
+
+constexpr Diet make_diet(bool can_eat_meat, bool can_eat_plants) {
+  return static_cast<Diet>((can_eat_meat ? 0b10 : 0) |
+                           (can_eat_plants ? 0b01 : 0));
+}
+
+constexpr bool diet_eats_meat(Diet diet) {
+  return (static_cast<uint8_t>(diet) & 0b10) != 0;
+}
+
+constexpr bool diet_eats_plants(Diet diet) {
+  return (static_cast<uint8_t>(diet) & 0b01) != 0;
+}
+
+constexpr bool diet_is_plant(Diet diet) {
+  return diet == Diet::plant;
+}
+
+constexpr bool diet_can_eat(Diet eater, Diet food) {
+  return diet_is_plant(food) ? diet_eats_plants(eater) : diet_eats_meat(eater);
+}
+
+// Rodzaj spotkania wynikający z samych preferencji (reguły 2 i 5-8).
+enum class Interaction : uint8_t {
+  illegal,            // 2. Dwie rośliny.
+  inert,              // 5. Nikt nikogo nie zje.
+  mutual,             // 6. Walka.
+  first_eats_plant,   // 7. Pierwszy zjada roślinę.
+  second_eats_plant,  // 7. Drugi zjada roślinę.
+  first_eats,         // 8. Tylko pierwszy może zjeść drugiego.
+  second_eats,        // 8. Tylko drugi może zjeść pierwszego.
+};
+
+constexpr Interaction derive_interaction(Diet diet1, Diet diet2) {
+  const bool eats1 = diet_can_eat(diet1, diet2);
+  const bool eats2 = diet_can_eat(diet2, diet1);
+  if (diet_is_plant(diet1) && diet_is_plant(diet2)) {
+    return Interaction::illegal;
+  }
+  if (!eats1 && !eats2) {
+    return Interaction::inert;
+  }
+  if (eats1 && eats2) {
+    return Interaction::mutual;
+  }
+  if (eats1) {
+    return diet_is_plant(diet2) ? Interaction::first_eats_plant
+                                : Interaction::first_eats;
+  }
+  return diet_is_plant(diet1) ? Interaction::second_eats_plant
+                              : Interaction::second_eats;
+}
+
+// Tablica 4x4 wszystkich par preferencji, indeksowana kodami Diet.
+inline constexpr std::array<Interaction, 16> interaction_table = [] {
+  std::array<Interaction, 16> table{};
+  for (uint8_t diet1 = 0; diet1 < 4; ++diet1) {
+    for (uint8_t diet2 = 0; diet2 < 4; ++diet2) {
+      table[diet1 * 4 + diet2] = derive_interaction(static_cast<Diet>(diet1),
+                                                    static_cast<Diet>(diet2));
+    }
+  }
+  return table;
+}();
+
+constexpr Interaction diet_interaction(Diet diet1, Diet diet2) {
+  return interaction_table[static_cast<uint8_t>(diet1) * 4 +
+                           static_cast<uint8_t>(diet2)];
+}
+
+// Co zrobić, gdy suma witalności nie mieści się w typie witalności.
+enum class VitalityOverflow : uint8_t {
+  wrap,      // Reszta modulo 2^n, jak w zwykłym dodawaniu.
+  saturate,  // Największa możliwa witalność.
+  check,     // Wyjątek overflow_error.
+};
+
+// Polityki arytmetyki witalności: value_type to typ witalności, add to
+// zjedzenie (dodanie zdobyczy), a mean to witalność dziecka. Poza wrapping
+// mean liczy dokładną średnią, która nigdy się nie przepełnia. Węższy typ niż
+// vitality_t zmniejsza organizmy i kolumny populacji; żeby duże witalności
+// nie zawijały się do małych, najlepiej łączyć go z nasycaniem.
+template <typename T>
+concept vitality_policy =
+    std::unsigned_integral<typename T::value_type> &&
+    requires(typename T::value_type a, typename T::value_type b) {
+  { T::overflow } -> std::convertible_to<VitalityOverflow>;
+  { T::add(a, b) } -> std::same_as<typename T::value_type>;
+  { T::mean(a, b) } -> std::same_as<typename T::value_type>;
+};
+
+// Największa witalność polityki. Polityka może ją podać jako max, jeśli jest
+// mniejsza niż największa wartość value_type.
+template <vitality_policy policy_t>
+constexpr typename policy_t::value_type vitality_max() {
+  if constexpr (requires { policy_t::max; }) {
+    return policy_t::max;
+  } else {
+    return std::numeric_limits<typename policy_t::value_type>::max();
+  }
+}
+
+template <std::unsigned_integral value_t>
+struct basic_wrapping_vitality {
+  using value_type = value_t;
+  static constexpr VitalityOverflow overflow = VitalityOverflow::wrap;
+
+  static constexpr value_t add(value_t a, value_t b) {
+    return static_cast<value_t>(a + b);
+  }
+
+  static constexpr value_t mean(value_t a, value_t b) {
+    return static_cast<value_t>(a + b) / 2;
+  }
+};
+
+// Bez rozgałęzień: przy przepełnieniu maska z samych jedynek.
+template <std::unsigned_integral value_t>
+struct basic_saturating_vitality {
+  using value_type = value_t;
+  static constexpr VitalityOverflow overflow = VitalityOverflow::saturate;
+
+  static constexpr value_t add(value_t a, value_t b) {
+    const auto sum = static_cast<value_t>(a + b);
+    return static_cast<value_t>(sum | -static_cast<value_t>(sum < a));
+  }
+
+  static constexpr value_t mean(value_t a, value_t b) {
+    return static_cast<value_t>(a / 2 + b / 2 + (a & b & 1));
+  }
+};
+
+template <std::unsigned_integral value_t>
+struct basic_checked_vitality {
+  using value_type = value_t;
+  static constexpr VitalityOverflow overflow = VitalityOverflow::check;
+
+  static constexpr value_t add(value_t a, value_t b) {
+    if (b > std::numeric_limits<value_t>::max() - a) {
+      throw overflow_error("Vitality overflow");
+    }
+    return static_cast<value_t>(a + b);
+  }
+
+  static constexpr value_t mean(value_t a, value_t b) {
+    return basic_saturating_vitality<value_t>::mean(a, b);
+  }
+};
+
+using wrapping_vitality = basic_wrapping_vitality<vitality_t>;
+using saturating_vitality = basic_saturating_vitality<vitality_t>;
+using checked_vitality = basic_checked_vitality<vitality_t>;
+
+template <typename species_t, bool can_eat_meat, bool can_eat_plants,
+          vitality_policy policy_t = wrapping_vitality>
 requires equality_comparable<species_t> class Organism {
-  const species_t species;
-  const vitality_t vitality;
+ public:
+  using vitality_type = typename policy_t::value_type;
+
+ private:
+  // Pola nie są const, żeby organizmy dało się przenosić i przypisywać;
+  // interfejs i tak pozwala tylko tworzyć nowe organizmy.
+  species_t species;
+  vitality_type vitality;
 
  public:
-  constexpr vitality_t get_vitality() const {
+  static constexpr Diet diet = make_diet(can_eat_meat, can_eat_plants);
+  using policy = policy_t;
+
+  constexpr vitality_type get_vitality() const {
     return vitality;
   }
   constexpr bool is_dead() const {
     return vitality == 0;
   }
 
-  constexpr Organism(species_t const &species, uint64_t vitality)
+  constexpr Organism(species_t const &species, vitality_type vitality)
       : species(species), vitality(vitality) {
   }
 
+  constexpr Organism(species_t &&species, vitality_type vitality)
+      : species(std::move(species)), vitality(vitality) {
+  }
+
   constexpr const species_t &get_species() const {
     return species;
   }
 
   template <bool x, bool y>
-  constexpr bool can_eat(const Organism<species_t, x, y> &that) const {
+  constexpr bool can_eat(
+      const Organism<species_t, x, y, policy_t> &that) const {
     if (can_eat_meat && !that.is_plant()) {
       return true;
     }
@@ -52,130 +234,232 @@ requires equality_comparable<species_t> class Organism {
 
   template <bool can_other_eat_meat, bool can_other_eat_plants>
   constexpr bool are_species_equal(
-      const Organism<species_t, can_other_eat_meat, can_other_eat_plants>
-          &other) const {
+      const Organism<species_t, can_other_eat_meat, can_other_eat_plants,
+                     policy_t> &other) const {
     return (species == other.get_species() &&
             can_eat_meat == can_other_eat_meat &&
             can_eat_plants == can_other_eat_plants);
   }
 
-  constexpr auto set_vitality(vitality_t new_vitality) const {
+  // Wersje && przenoszą gatunek do wyniku zamiast go kopiować.
+  constexpr auto set_vitality(vitality_type new_vitality) const & {
     return Organism(species, new_vitality);
   }
+  constexpr auto set_vitality(vitality_type new_vitality) && {
+    return Organism(std::move(species), new_vitality);
+  }
 
-  constexpr auto add_vitality(vitality_t change) const {
-    return set_vitality(get_vitality() + change);
+  constexpr auto add_vitality(vitality_type change) const & {
+    return set_vitality(policy_t::add(get_vitality(), change));
+  }
+  constexpr auto add_vitality(vitality_type change) && {
+    return std::move(*this).set_vitality(
+        policy_t::add(get_vitality(), change));
   }
 
-  constexpr auto kill() const {
+  constexpr auto kill() const & {
     return set_vitality(0);
   }
+  constexpr auto kill() && {
+    return std::move(*this).set_vitality(0);
+  }
 };
 
-template <typename species_t>
-using Carnivore = Organism<species_t, true, false>;
-template <typename species_t>
-using Omnivore = Organism<species_t, true, true>;
-template <typename species_t>
-using Herbivore = Organism<species_t, false, true>;
-template <typename species_t>
-using Plant = Organism<species_t, false, false>;
+template <typename species_t, vitality_policy policy_t = wrapping_vitality>
+using Carnivore = Organism<species_t, true, false, policy_t>;
+template <typename species_t, vitality_policy policy_t = wrapping_vitality>
+using Omnivore = Organism<species_t, true, true, policy_t>;
+template <typename species_t, vitality_policy policy_t = wrapping_vitality>
+using Herbivore = Organism<species_t, false, true, policy_t>;
+template <typename species_t, vitality_policy policy_t = wrapping_vitality>
+using Plant = Organism<species_t, false, false, policy_t>;
 
-template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, bool sp2_eats_m,
-          bool sp2_eats_p>
-constexpr tuple<Organism<species_t, sp1_eats_m, sp1_eats_p>,
-                Organism<species_t, sp2_eats_m, sp2_eats_p>,
-                optional<Organism<species_t, sp1_eats_m, sp1_eats_p>>>
-encounter(Organism<species_t, sp1_eats_m, sp1_eats_p> organism1,
-          Organism<species_t, sp2_eats_m, sp2_eats_p> organism2) {
-  decltype(encounter(organism1, organism2)) nothing_happens = {
-      organism1, organism2, nullopt};
+// Skutek spotkania bez samych organizmów: nowe witalności obu stron, to, czy
+// urodziło się dziecko (gatunku i preferencji pierwszego organizmu), i reguła,
+// która rozstrzygnęła spotkanie.
+template <typename vitality_type = vitality_t>
+struct basic_encounter_outcome {
+  vitality_type vitality1;
+  vitality_type vitality2;
+  vitality_type child_vitality;
+  bool has_child;
+  EncounterRule rule;
+};
+
+using encounter_outcome = basic_encounter_outcome<>;
+
+// Reguły 3-8 dla organizmów, których preferencje są znane dopiero w czasie
+// wykonania. Zamiast drabiny warunków na dietach jest jedno odczytanie
+// interaction_table; dla organizmów z szablonu diety są stałymi, więc
+// kompilator zostawia tylko gałąź, która może zajść. Witalności są dodawane
+// zgodnie z policy_t.
+template <vitality_policy policy_t = wrapping_vitality>
+constexpr basic_encounter_outcome<typename policy_t::value_type>
+encounter_outcome_of(Diet diet1, Diet diet2, bool same_species,
+                     typename policy_t::value_type vitality1,
+                     typename policy_t::value_type vitality2) {
+  using vitality_type = typename policy_t::value_type;
+  const vitality_type zero = 0;
+  auto outcome = [](EncounterRule rule, vitality_type new_vitality1,
+                    vitality_type new_vitality2) {
+    count_encounter_rule(rule);
+    return basic_encounter_outcome<vitality_type>{new_vitality1, new_vitality2,
+                                                  0, false, rule};
+  };
+  const Interaction interaction = diet_interaction(diet1, diet2);
 
   // 2. Nie jest możliwe spotkanie dwóch roślin.
-  static_assert(!organism1.is_plant() || !organism2.is_plant());
+  if (interaction == Interaction::illegal) {
+    throw logic_error("Two plants cannot meet");
+  }
 
   // 3. Spotkanie, w którym jedna ze stron jest martwa.
-  if (organism1.is_dead() || organism2.is_dead()) {
-    return nothing_happens;
+  if (vitality1 == 0 || vitality2 == 0) {
+    return outcome(EncounterRule::dead, vitality1, vitality2);
   }
 
   // 4. Spotkanie dwóch zwierząt tego samego gatunku.
-  if (organism1.are_species_equal(organism2)) {
-    return {organism1,
-            organism2,
-            {{organism1.get_species(),
-              (organism1.get_vitality() + organism2.get_vitality()) / 2}}};
-  }
-
-  // 5. Spotkanie organizmów, które nie potrafią się zjadać, nie przynosi
-  // efektów.
-  if (!organism1.can_eat(organism2) && !organism2.can_eat(organism1)) {
-    return nothing_happens;
-  }
-
-  // 6. Spotkanie dwóch zwierząt, które potrafią się nawzajem zjadać.
-  if ((!organism1.is_plant() && !organism2.is_plant()) &&
-      (organism1.can_eat(organism2) && organism2.can_eat(organism1))) {
-    bool organism1_dies = organism2.get_vitality() >= organism1.get_vitality();
-    bool organism2_dies = organism1.get_vitality() >= organism2.get_vitality();
-    return {
-        (organism1_dies ? organism1.kill()
-                        : organism1.add_vitality(organism2.get_vitality() / 2)),
-        (organism2_dies ? organism2.kill()
-                        : organism2.add_vitality(organism1.get_vitality() / 2)),
-        nullopt};
-  }
-
-  // 7. Spotkanie roślinożercy lub wszystkożercy z rośliną skutkuje tym, że
-  // roślina zostaje zjedzona.
-  if (organism2.is_plant() && organism1.can_eat(organism2)) {
-    return {organism1.add_vitality(organism2.get_vitality()), organism2.kill(),
-            nullopt};
-  }
-  if (organism1.is_plant() && organism2.can_eat(organism1)) {
-    return {organism1.kill(), organism2.add_vitality(organism1.get_vitality()),
-            nullopt};
-  }
-
-  // 8. Spotkanie, w którym zdolność do konsumpcji zachodzi tylko w jedną
-  // stronę.
-  if (organism1.can_eat(organism2)) {
-    if (organism2.get_vitality() >= organism1.get_vitality()) {
-      return nothing_happens;
-    }
-    return {organism1.add_vitality(organism2.get_vitality() / 2),
-            organism2.kill(), nullopt};
+  if (same_species && diet1 == diet2) {
+    count_encounter_rule(EncounterRule::same_species);
+    return {vitality1, vitality2, policy_t::mean(vitality1, vitality2), true,
+            EncounterRule::same_species};
   }
-  if (organism2.can_eat(organism1)) {
-    if (organism1.get_vitality() >= organism2.get_vitality()) {
-      return nothing_happens;
-    }
-    return {organism1.kill(),
-            organism2.add_vitality(organism1.get_vitality() / 2), nullopt};
+
+  switch (interaction) {
+    // 5. Spotkanie organizmów, które nie potrafią się zjadać, nie przynosi
+    // efektów.
+    case Interaction::inert:
+      return outcome(EncounterRule::inert, vitality1, vitality2);
+
+    // 6. Spotkanie dwóch zwierząt, które potrafią się nawzajem zjadać.
+    case Interaction::mutual:
+      return outcome(
+          EncounterRule::mutual,
+          vitality2 >= vitality1 ? zero
+                                 : policy_t::add(vitality1, vitality2 / 2),
+          vitality1 >= vitality2 ? zero
+                                 : policy_t::add(vitality2, vitality1 / 2));
+
+    // 7. Spotkanie roślinożercy lub wszystkożercy z rośliną skutkuje tym, że
+    // roślina zostaje zjedzona.
+    case Interaction::first_eats_plant:
+      return outcome(EncounterRule::plant_eaten,
+                     policy_t::add(vitality1, vitality2), zero);
+    case Interaction::second_eats_plant:
+      return outcome(EncounterRule::plant_eaten, zero,
+                     policy_t::add(vitality2, vitality1));
+
+    // 8. Spotkanie, w którym zdolność do konsumpcji zachodzi tylko w jedną
+    // stronę.
+    case Interaction::first_eats:
+      if (vitality2 >= vitality1) {
+        return outcome(EncounterRule::one_way_fail, vitality1, vitality2);
+      }
+      return outcome(EncounterRule::one_way_success,
+                     policy_t::add(vitality1, vitality2 / 2), zero);
+    case Interaction::second_eats:
+      if (vitality1 >= vitality2) {
+        return outcome(EncounterRule::one_way_fail, vitality1, vitality2);
+      }
+      return outcome(EncounterRule::one_way_success, zero,
+                     policy_t::add(vitality2, vitality1 / 2));
+
+    case Interaction::illegal:
+      break;
   }
 
   throw logic_error("Illegal state");
 }
 
-// Ponadto rozwiązanie powinno udostępniać szablon [o taki].
-template <typename species_t, bool sp1_eats_m, bool sp1_eats_p,
-          typename... Args>
-constexpr Organism<species_t, sp1_eats_m, sp1_eats_p> encounter_series(
-    Organism<species_t, sp1_eats_m, sp1_eats_p> organism1, Args... args);
-
-// [Rekurencyjna implementacja.]
-template <typename species_t, bool sp1_eats_m, bool sp1_eats_p>
-constexpr Organism<species_t, sp1_eats_m, sp1_eats_p>
-encounter_series(Organism<species_t, sp1_eats_m, sp1_eats_p> organism1) {
-  return organism1;
+// Spotkanie bez budowania nowych organizmów.
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, bool sp2_eats_m,
+          bool sp2_eats_p, typename policy_t>
+constexpr basic_encounter_outcome<typename policy_t::value_type>
+encounter_vitalities(
+    const Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t> &organism1,
+    const Organism<species_t, sp2_eats_m, sp2_eats_p, policy_t> &organism2) {
+  constexpr Diet diet1 = make_diet(sp1_eats_m, sp1_eats_p);
+  constexpr Diet diet2 = make_diet(sp2_eats_m, sp2_eats_p);
+
+  // 2. Nie jest możliwe spotkanie dwóch roślin.
+  static_assert(diet_interaction(diet1, diet2) != Interaction::illegal);
+
+  return encounter_outcome_of<policy_t>(
+      diet1, diet2, organism1.are_species_equal(organism2),
+      organism1.get_vitality(), organism2.get_vitality());
 }
+
+// Wersja z krotką organizmów, zbudowana z encounter_vitalities. Organizmy są
+// przenoszone do wyniku, więc gatunek kopiuje się tylko dla dziecka.
 template <typename species_t, bool sp1_eats_m, bool sp1_eats_p, bool sp2_eats_m,
-          bool sp2_eats_p, typename... Args>
-constexpr Organism<species_t, sp1_eats_m, sp1_eats_p>
-encounter_series(Organism<species_t, sp1_eats_m, sp1_eats_p> organism1,
-                 Organism<species_t, sp2_eats_m, sp2_eats_p> organism2,
-                 Args... args) {
-  return encounter_series(get<0>(encounter(organism1, organism2)), args...);
+          bool sp2_eats_p, typename policy_t>
+constexpr tuple<Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t>,
+                Organism<species_t, sp2_eats_m, sp2_eats_p, policy_t>,
+                optional<Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t>>>
+encounter(Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t> organism1,
+          Organism<species_t, sp2_eats_m, sp2_eats_p, policy_t> organism2) {
+  const auto outcome = encounter_vitalities(organism1, organism2);
+  optional<Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t>> child;
+  if (outcome.has_child) {
+    child.emplace(organism1.get_species(), outcome.child_vitality);
+    count_offspring();
+  }
+  return {std::move(organism1).set_vitality(outcome.vitality1),
+          std::move(organism2).set_vitality(outcome.vitality2),
+          std::move(child)};
+}
+
+template <typename T, typename species_t,
+          typename policy_t = wrapping_vitality>
+struct is_organism_of : std::false_type {};
+template <typename species_t, bool can_eat_meat, bool can_eat_plants,
+          typename policy_t>
+struct is_organism_of<
+    Organism<species_t, can_eat_meat, can_eat_plants, policy_t>, species_t,
+    policy_t> : std::true_type {};
+
+// Wynik serii spotkań razem z liczbą spotkań, które faktycznie się odbyły.
+template <typename hunter_t>
+struct series_result {
+  hunter_t hunter;
+  size_t encounters;
+};
+
+// Seria spotkań kończy się, gdy pierwszy organizm zginie: dalsze spotkania
+// i tak niczego by nie zmieniły (reguła 3).
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p,
+          typename policy_t, typename... Args>
+requires(is_organism_of<Args, species_t, policy_t>::value &&...)
+constexpr series_result<Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t>>
+encounter_series_counted(
+    Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t> organism1,
+    Args... args) {
+  size_t encounters = 0;
+  [[maybe_unused]] auto meet = [&](auto &&other) {
+    if (organism1.is_dead()) {
+      return false;
+    }
+    organism1 = get<0>(encounter(std::move(organism1), std::move(other)));
+    ++encounters;
+    return true;
+  };
+  static_cast<void>((meet(std::move(args)) && ...));
+  return {std::move(organism1), encounters};
+}
+
+// Ponadto rozwiązanie powinno udostępniać szablon [o taki].
+// [Implementacja przez wyrażenie fold: jedna instancja na serię i pętla
+// zamiast rekurencji, więc długie serie nie wyczerpują limitu głębokości
+// constexpr.]
+template <typename species_t, bool sp1_eats_m, bool sp1_eats_p,
+          typename policy_t, typename... Args>
+requires(is_organism_of<Args, species_t, policy_t>::value &&...)
+constexpr Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t>
+encounter_series(
+    Organism<species_t, sp1_eats_m, sp1_eats_p, policy_t> organism1,
+    Args... args) {
+  return encounter_series_counted(std::move(organism1), std::move(args)...)
+      .hunter;
 }
 
 #endif  // JNP1_ORGANISM_H
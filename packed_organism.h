@@ -0,0 +1,211 @@
+#ifndef JNP1_PACKED_ORGANISM_H
+#define JNP1_PACKED_ORGANISM_H
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "encounter_counters.h"
+#include "encounter_kernel.h"
+#include "organism.h"
+#include "population.h"
+
+namespace {
+using std::vector, std::span, std::out_of_range, std::invalid_argument;
+}  // namespace
+
+// Organizm małego gatunku zapisany w jednym słowie 64-bitowym: witalność
+// w bitach 0-47, gatunek w bitach 48-61 i dieta w dwóch najwyższych. Osiem
+// organizmów mieści się w jednej linii pamięci, a spotkanie czyta po jednym
+// słowie na organizm.
+
+inline constexpr vitality_t packed_vitality_max = (vitality_t{1} << 48) - 1;
+
+// Polityki dla witalności mieszczących się w 48 bitach, z value_type
+// vitality_t. Argumenty nie mogą przekraczać packed_vitality_max, więc suma
+// nigdy nie przepełnia samego vitality_t.
+template <VitalityOverflow overflow_kind>
+struct packed_vitality {
+  using value_type = vitality_t;
+  static constexpr VitalityOverflow overflow = overflow_kind;
+  static constexpr vitality_t max = packed_vitality_max;
+
+  static constexpr vitality_t add(vitality_t a, vitality_t b) {
+    const vitality_t sum = a + b;
+    if constexpr (overflow == VitalityOverflow::wrap) {
+      return sum & max;
+    } else if constexpr (overflow == VitalityOverflow::saturate) {
+      return sum > max ? max : sum;
+    } else {
+      if (sum > max) {
+        throw overflow_error("Vitality overflow");
+      }
+      return sum;
+    }
+  }
+
+  static constexpr vitality_t mean(vitality_t a, vitality_t b) {
+    if constexpr (overflow == VitalityOverflow::wrap) {
+      return ((a + b) & max) / 2;
+    } else {
+      return (a + b) / 2;
+    }
+  }
+};
+
+using packed_wrapping_vitality = packed_vitality<VitalityOverflow::wrap>;
+using packed_saturating_vitality = packed_vitality<VitalityOverflow::saturate>;
+using packed_checked_vitality = packed_vitality<VitalityOverflow::check>;
+
+// Gatunki, które mieszczą się w 14 bitach: całe typy 8-bitowe, a z 16-bitowych
+// wartości do 2^14 - 1.
+template <typename T>
+concept packable_species = std::integral<T> && sizeof(T) <= 2;
+
+// Odpowiednik AnyOrganism w 8 bajtach. Polityka to jedna z packed_vitality
+// albo polityka typu węższego niż 48 bitów.
+template <packable_species species_t,
+          vitality_policy policy_t = packed_wrapping_vitality>
+requires(vitality_max<policy_t>() <= packed_vitality_max) class PackedOrganism {
+ public:
+  using vitality_type = typename policy_t::value_type;
+
+ private:
+  static constexpr unsigned species_shift = 48;
+  static constexpr unsigned diet_shift = 62;
+  static constexpr uint64_t species_limit = uint64_t{1} << 14;
+
+  uint64_t bits;
+
+  struct unchecked {};
+
+  constexpr PackedOrganism(unchecked, uint64_t bits) : bits(bits) {
+  }
+
+  // Wyniki polityki nigdy nie przekraczają vitality_max, więc jądro spotkań
+  // nie musi ich sprawdzać.
+  constexpr PackedOrganism with_vitality(vitality_type new_vitality) const {
+    return {unchecked{}, (bits & ~packed_vitality_max) | new_vitality};
+  }
+
+  template <typename other_species_t, typename other_policy_t>
+  friend size_t encounter_batch(
+      vector<PackedOrganism<other_species_t, other_policy_t>> &organisms,
+      span<const encounter_pair_t> pairs);
+
+  static constexpr uint64_t species_bits(species_t species) {
+    const auto id = static_cast<std::make_unsigned_t<species_t>>(species);
+    if (id >= species_limit) {
+      throw out_of_range("Species does not fit in a packed organism");
+    }
+    return uint64_t{id};
+  }
+
+ public:
+  constexpr PackedOrganism(species_t species, Diet diet, vitality_t vitality)
+      : bits(species_bits(species) << species_shift |
+             uint64_t{static_cast<uint8_t>(diet)} << diet_shift | vitality) {
+    if (vitality > vitality_max<policy_t>()) {
+      throw out_of_range("Vitality does not fit in a packed organism");
+    }
+  }
+
+  template <bool can_eat_meat, bool can_eat_plants>
+  constexpr PackedOrganism(
+      Organism<species_t, can_eat_meat, can_eat_plants, policy_t> const
+          &organism)
+      : PackedOrganism(organism.get_species(), organism.diet,
+                       organism.get_vitality()) {
+  }
+
+  constexpr vitality_type get_vitality() const {
+    return static_cast<vitality_type>(bits & packed_vitality_max);
+  }
+
+  constexpr bool is_dead() const {
+    return get_vitality() == 0;
+  }
+
+  constexpr species_t get_species() const {
+    return static_cast<species_t>((bits >> species_shift) &
+                                  (species_limit - 1));
+  }
+
+  constexpr Diet get_diet() const {
+    return static_cast<Diet>(bits >> diet_shift);
+  }
+
+  constexpr bool is_plant() const {
+    return diet_is_plant(get_diet());
+  }
+
+  // Ten sam gatunek i dieta (reguła 4), jednym porównaniem.
+  constexpr bool same_species(PackedOrganism other) const {
+    return (bits >> species_shift) == (other.bits >> species_shift);
+  }
+
+  constexpr PackedOrganism set_vitality(vitality_type new_vitality) const {
+    if (new_vitality > vitality_max<policy_t>()) {
+      throw out_of_range("Vitality does not fit in a packed organism");
+    }
+    return with_vitality(new_vitality);
+  }
+
+  // Powrót do organizmu z szablonu; preferencje muszą się zgadzać.
+  template <bool can_eat_meat, bool can_eat_plants>
+  constexpr Organism<species_t, can_eat_meat, can_eat_plants, policy_t> as()
+      const {
+    if (get_diet() != make_diet(can_eat_meat, can_eat_plants)) {
+      throw invalid_argument("Diet mismatch");
+    }
+    return {get_species(), get_vitality()};
+  }
+};
+
+static_assert(sizeof(PackedOrganism<uint8_t>) == 8);
+
+// Odpowiednik encounter_batch populacji dla tablicy spakowanych organizmów:
+// pary po kolei, dzieci na koniec organisms. Zwraca liczbę urodzonych.
+template <typename species_t, typename policy_t>
+size_t encounter_batch(vector<PackedOrganism<species_t, policy_t>> &organisms,
+                       span<const encounter_pair_t> pairs) {
+  using vitality_type = typename policy_t::value_type;
+  size_t births = 0;
+  for (const auto &[index1, index2] : pairs) {
+    const PackedOrganism<species_t, policy_t> organism1 = organisms[index1];
+    const PackedOrganism<species_t, policy_t> organism2 = organisms[index2];
+    const Diet diet1 = organism1.get_diet();
+    const Diet diet2 = organism2.get_diet();
+    if (diet_is_plant(diet1) && diet_is_plant(diet2)) {
+      throw logic_error("Two plants cannot meet");
+    }
+    vitality_type v1 = organism1.get_vitality();
+    vitality_type v2 = organism2.get_vitality();
+    vitality_type child_vitality;
+    const bool same_species = organism1.same_species(organism2);
+    const bool eats1 = diet_can_eat(diet1, diet2);
+    const bool eats2 = diet_can_eat(diet2, diet1);
+    if constexpr (encounter_counters_enabled) {
+      count_encounter_rule(encounter_lane_rule(v1, v2, same_species, eats1,
+                                               eats2, diet_is_plant(diet1),
+                                               diet_is_plant(diet2)));
+    }
+    const bool has_child = encounter_lane<policy_t>(
+        v1, v2, same_species, eats1, eats2, diet_is_plant(diet1),
+        diet_is_plant(diet2), child_vitality);
+    organisms[index1] = organism1.with_vitality(v1);
+    organisms[index2] = organism2.with_vitality(v2);
+    if (has_child) {
+      organisms.push_back(organism1.with_vitality(child_vitality));
+      count_offspring();
+      ++births;
+    }
+  }
+  return births;
+}
+
+#endif  // JNP1_PACKED_ORGANISM_H
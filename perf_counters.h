@@ -0,0 +1,178 @@
+#ifndef JNP1_PERF_COUNTERS_H
+#define JNP1_PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <system_error>
+
+// Liczniki procesora z perf_event_open dla wątku, który je otworzył, i dla
+// wątków, które utworzy później (pulę wątków trzeba więc tworzyć po
+// licznikach). Liczy się tylko praca w przestrzeni użytkownika, więc
+// wystarcza perf_event_paranoid <= 2. Licznik, którego nie ma (maszyna
+// wirtualna bez PMU, zakaz w jądrze), jest niedostępny, a nie błędem; wtedy
+// zostaje przynajmniej task_clock.
+
+enum class PerfEvent : uint8_t {
+  cycles,
+  instructions,
+  branch_misses,
+  cache_misses,  // Chybienia w ostatnim poziomie pamięci podręcznej.
+  task_clock,    // Czas procesora w nanosekundach, licznik programowy.
+};
+
+inline constexpr size_t perf_event_count = 5;
+
+constexpr std::string_view perf_event_name(PerfEvent event) {
+  constexpr std::string_view names[perf_event_count] = {
+      "cycles", "instructions", "branch-misses", "cache-misses", "task-clock"};
+  return names[static_cast<size_t>(event)];
+}
+
+// Odczyt wszystkich liczników; niedostępne nie mają wartości.
+struct perf_sample {
+  std::array<std::optional<uint64_t>, perf_event_count> values;
+
+  std::optional<uint64_t> operator[](PerfEvent event) const {
+    return values[static_cast<size_t>(event)];
+  }
+};
+
+class PerfCounters {
+  std::array<int, perf_event_count> fds;
+  std::array<int, perf_event_count> errors{};
+
+  static perf_event_attr event_attr(PerfEvent event) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    if (event == PerfEvent::task_clock) {
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    } else {
+      constexpr uint64_t configs[] = {
+          PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+          PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[static_cast<size_t>(event)];
+    }
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Przy większej liczbie liczników niż rejestrów jądro je przełącza;
+    // wartości są wtedy skalowane czasem, w którym licznik działał.
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return attr;
+  }
+
+  // Błędy, którymi jądro odpowiada na brak licznika albo zakaz.
+  static bool is_unavailable(int error) {
+    return error == ENOENT || error == ENODEV || error == EOPNOTSUPP ||
+           error == EACCES || error == EPERM || error == ENOSYS;
+  }
+
+  void control(unsigned long request) {
+    for (const int fd : fds) {
+      if (fd >= 0 && ::ioctl(fd, request, 0) < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "perf_event ioctl");
+      }
+    }
+  }
+
+  void close_all() {
+    for (const int fd : fds) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+ public:
+  PerfCounters() {
+    fds.fill(-1);
+    for (size_t event = 0; event < perf_event_count; ++event) {
+      perf_event_attr attr = event_attr(static_cast<PerfEvent>(event));
+      fds[event] = static_cast<int>(
+          ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fds[event] < 0) {
+        errors[event] = errno;
+        if (!is_unavailable(errors[event])) {
+          close_all();
+          throw std::system_error(errors[event], std::generic_category(),
+                                  "perf_event_open");
+        }
+      }
+    }
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  ~PerfCounters() {
+    close_all();
+  }
+
+  bool available(PerfEvent event) const {
+    return fds[static_cast<size_t>(event)] >= 0;
+  }
+
+  // Dlaczego licznik jest niedostępny; pusty kod dla dostępnych.
+  std::error_code unavailable_reason(PerfEvent event) const {
+    const int error = errors[static_cast<size_t>(event)];
+    return error == 0 ? std::error_code()
+                      : std::error_code(error, std::generic_category());
+  }
+
+  // Zeruje liczniki i zaczyna liczyć.
+  void start() {
+    control(PERF_EVENT_IOC_RESET);
+    control(PERF_EVENT_IOC_ENABLE);
+  }
+
+  perf_sample read() const {
+    perf_sample sample;
+    for (size_t event = 0; event < perf_event_count; ++event) {
+      if (fds[event] < 0) {
+        continue;
+      }
+      uint64_t value[3];  // Wartość, czas włączenia, czas działania.
+      if (::read(fds[event], value, sizeof(value)) !=
+          static_cast<ssize_t>(sizeof(value))) {
+        throw std::system_error(errno, std::generic_category(),
+                                "perf_event read");
+      }
+      sample.values[event] =
+          value[2] == 0 || value[2] == value[1]
+              ? value[0]
+              : static_cast<uint64_t>(static_cast<double>(value[0]) *
+                                      static_cast<double>(value[1]) /
+                                      static_cast<double>(value[2]));
+    }
+    return sample;
+  }
+
+  // Kończy liczenie i zwraca wartości od start.
+  perf_sample stop() {
+    control(PERF_EVENT_IOC_DISABLE);
+    return read();
+  }
+
+  template <typename function_t>
+  perf_sample measure(function_t &&function) {
+    start();
+    function();
+    return stop();
+  }
+};
+
+#endif  // JNP1_PERF_COUNTERS_H
@@ -0,0 +1,738 @@
+#ifndef JNP1_POPULATION_H
+#define JNP1_POPULATION_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "birth_arena.h"
+#include "encounter_kernel.h"
+#include "organism.h"
+#include "species_registry.h"
+
+namespace {
+using population_index_t = uint32_t;
+using encounter_pair_t = std::pair<population_index_t, population_index_t>;
+using std::vector, std::span, std::invalid_argument;
+}  // namespace
+
+// Zbiór organizmów o wspólnym typie gatunku, przechowywany kolumnami (numer
+// gatunku, witalność, preferencje żywieniowe), żeby pętle po wielu organizmach
+// naraz czytały tylko ciągłe fragmenty pamięci. Same gatunki są w rejestrze.
+// Typ witalności i arytmetyka na niej pochodzą z policy_t, tak jak w Organism;
+// wszystkie funkcje spotkań poniżej liczą według polityki populacji.
+template <typename species_t, vitality_policy policy_t = wrapping_vitality>
+requires equality_comparable<species_t> class Population {
+ public:
+  using vitality_type = typename policy_t::value_type;
+
+ private:
+  SpeciesRegistry<species_t> registry;
+  vector<species_handle> species;
+  vector<vitality_type> vitality;
+  vector<Diet> diet;
+  // Martwe organizmy zostają na swoich miejscach aż do compact.
+  size_t dead = 0;
+  double compaction_threshold = 0.5;
+  size_t carrying_capacity = SIZE_MAX;
+
+ public:
+  // Numer w remap dla organizmu usuniętego przez compact.
+  static constexpr population_index_t removed = UINT32_MAX;
+
+  size_t size() const {
+    return vitality.size();
+  }
+
+  void reserve(size_t capacity) {
+    species.reserve(capacity);
+    vitality.reserve(capacity);
+    diet.reserve(capacity);
+  }
+
+  // Miejsce na additional kolejnych organizmów. Pojemność rośnie co najmniej
+  // dwukrotnie, żeby dopisywanie dzieci co rundę nie kopiowało kolumn za
+  // każdym razem.
+  void reserve_additional(size_t additional) {
+    const size_t needed = size() + additional;
+    if (needed > vitality.capacity()) {
+      reserve(std::max(needed, 2 * vitality.capacity()));
+    }
+  }
+
+  population_index_t add(species_handle new_species, Diet new_diet,
+                         vitality_type new_vitality) {
+    species.push_back(new_species);
+    vitality.push_back(new_vitality);
+    diet.push_back(new_diet);
+    dead += new_vitality == 0;
+    return static_cast<population_index_t>(size() - 1);
+  }
+
+  // Dopisuje całe kolumny naraz; numery gatunków muszą być już w rejestrze.
+  void append(span<const species_handle> new_species,
+              span<const vitality_type> new_vitality,
+              span<const Diet> new_diet) {
+    if (new_vitality.size() != new_species.size() ||
+        new_diet.size() != new_species.size()) {
+      throw invalid_argument("Column size mismatch");
+    }
+    reserve_additional(new_species.size());
+    species.insert(species.end(), new_species.begin(), new_species.end());
+    vitality.insert(vitality.end(), new_vitality.begin(), new_vitality.end());
+    diet.insert(diet.end(), new_diet.begin(), new_diet.end());
+    dead += std::count(new_vitality.begin(), new_vitality.end(), 0);
+  }
+
+  // Dopisuje dzieci z areny; dostają kolejne numery w populacji, w kolejności
+  // z areny. Dzieci, dla których zabrakło miejsca do carrying_capacity, nie
+  // są dopisywane wcale. Zwraca liczbę dopisanych.
+  size_t add_births(const BirthArena &births) {
+    const size_t added = std::min(births.size(), birth_room());
+    reserve_additional(added);
+    for (size_t index = 0; index < added; ++index) {
+      add(births[index].species, births[index].diet, births[index].vitality);
+    }
+    return added;
+  }
+
+  size_t add_births(const RoundBirths &births) {
+    const size_t added = std::min(births.size(), birth_room());
+    reserve_additional(added);
+    births.for_each(
+        [this](const birth_record &child) {
+          add(child.species, child.diet, child.vitality);
+        },
+        added);
+    return added;
+  }
+
+  population_index_t add(species_t const &new_species, Diet new_diet,
+                         vitality_type new_vitality) {
+    return add(registry.intern(new_species), new_diet, new_vitality);
+  }
+
+  // Numer gatunku w rejestrze populacji, także gatunku bez organizmów.
+  species_handle intern_species(species_t const &new_species) {
+    return registry.intern(new_species);
+  }
+
+  template <bool can_eat_meat, bool can_eat_plants>
+  population_index_t add(
+      Organism<species_t, can_eat_meat, can_eat_plants, policy_t> const
+          &organism) {
+    return add(organism.get_species(), organism.diet,
+               organism.get_vitality());
+  }
+
+  const species_t &get_species(population_index_t index) const {
+    return registry.get(species[index]);
+  }
+
+  species_handle get_species_handle(population_index_t index) const {
+    return species[index];
+  }
+
+  vitality_type get_vitality(population_index_t index) const {
+    return vitality[index];
+  }
+
+  Diet get_diet(population_index_t index) const {
+    return diet[index];
+  }
+
+  bool is_dead(population_index_t index) const {
+    return vitality[index] == 0;
+  }
+
+  void set_vitality(population_index_t index, vitality_type new_vitality) {
+    dead += (new_vitality == 0) - (vitality[index] == 0);
+    vitality[index] = new_vitality;
+  }
+
+  size_t dead_count() const {
+    return dead;
+  }
+
+  double dead_fraction() const {
+    return size() == 0 ? 0 : static_cast<double>(dead) / size();
+  }
+
+  // Dla kodu, który zabija organizmy, pisząc bezpośrednio do get_vitalities().
+  void record_deaths(size_t deaths) {
+    dead += deaths;
+  }
+
+  double get_compaction_threshold() const {
+    return compaction_threshold;
+  }
+
+  // Udział martwych, od którego compact_if_needed usuwa martwe organizmy.
+  void set_compaction_threshold(double threshold) {
+    compaction_threshold = threshold;
+  }
+
+  size_t get_carrying_capacity() const {
+    return carrying_capacity;
+  }
+
+  // Największa liczba żywych organizmów, do której add_births dopisuje dzieci
+  // z rund. Pozostałe dzieci giną, zanim staną się organizmami populacji.
+  // Zmniejszenie pojemności nie zabija żywych organizmów.
+  void set_carrying_capacity(size_t capacity) {
+    carrying_capacity = capacity;
+  }
+
+  // Ile dzieci zmieści się jeszcze do carrying_capacity.
+  size_t birth_room() const {
+    const size_t live = size() - dead;
+    return live >= carrying_capacity ? 0 : carrying_capacity - live;
+  }
+
+  // Usuwa martwe organizmy, zachowując kolejność żywych. Zwraca nowe numery
+  // dawnych organizmów (removed dla usuniętych).
+  vector<population_index_t> compact() {
+    vector<population_index_t> remap(size(), removed);
+    population_index_t live = 0;
+    for (population_index_t index = 0; index < size(); ++index) {
+      if (vitality[index] != 0) {
+        species[live] = species[index];
+        vitality[live] = vitality[index];
+        diet[live] = diet[index];
+        remap[index] = live++;
+      }
+    }
+    species.resize(live);
+    vitality.resize(live);
+    diet.resize(live);
+    dead = 0;
+    return remap;
+  }
+
+  // Usuwa organizmy o numerach z indices (bez powtórzeń), także żywe,
+  // zachowując kolejność pozostałych. Zwraca nowe numery jak compact.
+  vector<population_index_t> remove(span<const population_index_t> indices) {
+    vector<bool> removing(size());
+    for (const population_index_t index : indices) {
+      if (index >= size() || removing[index]) {
+        throw invalid_argument("Invalid organisms to remove");
+      }
+      removing[index] = true;
+    }
+    vector<population_index_t> remap(size(), removed);
+    population_index_t kept = 0;
+    for (population_index_t index = 0; index < size(); ++index) {
+      if (removing[index]) {
+        dead -= vitality[index] == 0;
+        continue;
+      }
+      species[kept] = species[index];
+      vitality[kept] = vitality[index];
+      diet[kept] = diet[index];
+      remap[index] = kept++;
+    }
+    species.resize(kept);
+    vitality.resize(kept);
+    diet.resize(kept);
+    return remap;
+  }
+
+  // Ustawia organizmy w kolejności order: organizm o dawnym numerze order[i]
+  // dostaje numer i. Zwraca nowe numery dawnych organizmów, jak compact.
+  vector<population_index_t> reorder(span<const population_index_t> order) {
+    if (order.size() != size()) {
+      throw invalid_argument("Order is not a permutation");
+    }
+    vector<population_index_t> remap(size(), removed);
+    vector<species_handle> new_species(size());
+    vector<vitality_type> new_vitality(size());
+    vector<Diet> new_diet(size());
+    for (population_index_t index = 0; index < size(); ++index) {
+      const population_index_t old = order[index];
+      if (old >= size() || remap[old] != removed) {
+        throw invalid_argument("Order is not a permutation");
+      }
+      remap[old] = index;
+      new_species[index] = species[old];
+      new_vitality[index] = vitality[old];
+      new_diet[index] = diet[old];
+    }
+    species = std::move(new_species);
+    vitality = std::move(new_vitality);
+    diet = std::move(new_diet);
+    return remap;
+  }
+
+  // compact, jeśli martwych jest co najmniej tyle, ile wynosi próg. Oczekujące
+  // pary są przenumerowywane, a pary z martwym organizmem (i tak bez skutków)
+  // są usuwane. Zwraca, czy populacja została uporządkowana.
+  bool compact_if_needed(vector<encounter_pair_t> &pending_pairs) {
+    if (dead == 0 || dead_fraction() < compaction_threshold) {
+      return false;
+    }
+    const auto remap = compact();
+    std::erase_if(pending_pairs, [&](encounter_pair_t &pair) {
+      pair = {remap[pair.first], remap[pair.second]};
+      return pair.first == removed || pair.second == removed;
+    });
+    return true;
+  }
+
+  bool compact_if_needed() {
+    vector<encounter_pair_t> no_pairs;
+    return compact_if_needed(no_pairs);
+  }
+
+  // Odtworzenie organizmu o znanych w czasie kompilacji preferencjach.
+  template <bool can_eat_meat, bool can_eat_plants>
+  Organism<species_t, can_eat_meat, can_eat_plants, policy_t> get(
+      population_index_t index) const {
+    if (diet[index] != make_diet(can_eat_meat, can_eat_plants)) {
+      throw invalid_argument("Diet mismatch");
+    }
+    return {get_species(index), vitality[index]};
+  }
+
+  span<const species_handle> get_species_handles() const {
+    return species;
+  }
+
+  const SpeciesRegistry<species_t> &get_registry() const {
+    return registry;
+  }
+
+  span<vitality_type> get_vitalities() {
+    return vitality;
+  }
+
+  span<const vitality_type> get_vitalities() const {
+    return vitality;
+  }
+
+  span<const Diet> get_diets() const {
+    return diet;
+  }
+};
+
+// Skutek spotkania pary organizmów z populacji, bez jej zmieniania.
+template <typename species_t, typename policy_t>
+basic_encounter_outcome<typename policy_t::value_type> encounter_outcome_at(
+    const Population<species_t, policy_t> &population,
+    population_index_t index1, population_index_t index2) {
+  return encounter_outcome_of<policy_t>(
+      population.get_diet(index1), population.get_diet(index2),
+      population.get_species_handle(index1) ==
+          population.get_species_handle(index2),
+      population.get_vitality(index1), population.get_vitality(index2));
+}
+
+// Zapisuje nowe witalności pary. Zwraca, czy urodziło się dziecko; jeśli tak,
+// opisuje je child, ale nie dopisuje go do populacji.
+template <typename species_t, typename policy_t>
+bool apply_outcome(
+    Population<species_t, policy_t> &population, population_index_t index1,
+    population_index_t index2,
+    const basic_encounter_outcome<typename policy_t::value_type> &outcome,
+    birth_record &child) {
+  population.set_vitality(index1, outcome.vitality1);
+  population.set_vitality(index2, outcome.vitality2);
+  if (outcome.has_child) {
+    child = {population.get_species_handle(index1),
+             population.get_diet(index1), outcome.child_vitality};
+    count_offspring();
+  }
+  return outcome.has_child;
+}
+
+// Obserwator spotkań, który niczego nie robi.
+struct no_encounter_observer {
+  template <typename... args_t>
+  constexpr void operator()(const args_t &...) const {
+  }
+};
+
+// Reguły 3-8 funkcji encounter zastosowane do pary organizmów z populacji.
+// Zmienia tylko witalności tej pary, więc rozłączne pary można liczyć
+// współbieżnie; z tego powodu nie zmienia też licznika martwych, tylko dodaje
+// zabitych do deaths (wołający przekazuje je potem do record_deaths). Zwraca,
+// czy urodziło się dziecko; jeśli tak, opisuje je child. Skutek spotkania
+// dostaje też observe(index1, index2, outcome), jeszcze przed zapisaniem
+// nowych witalności.
+template <typename species_t, typename policy_t,
+          typename observer_t = no_encounter_observer>
+bool encounter_rules(Population<species_t, policy_t> &population,
+                     population_index_t index1, population_index_t index2,
+                     birth_record &child, size_t &deaths,
+                     observer_t &&observe = {}) {
+  const auto outcome = encounter_outcome_at(population, index1, index2);
+  observe(index1, index2, outcome);
+  const auto vitalities = population.get_vitalities();
+  deaths += (vitalities[index1] != 0 && outcome.vitality1 == 0) +
+            (vitalities[index2] != 0 && outcome.vitality2 == 0);
+  vitalities[index1] = outcome.vitality1;
+  vitalities[index2] = outcome.vitality2;
+  if (outcome.has_child) {
+    child = {population.get_species_handle(index1),
+             population.get_diet(index1), outcome.child_vitality};
+    count_offspring();
+  }
+  return outcome.has_child;
+}
+
+// Spotkanie z dopisaniem dziecka na koniec populacji.
+template <typename species_t, typename policy_t>
+bool encounter_in_place(Population<species_t, policy_t> &population,
+                        population_index_t index1, population_index_t index2) {
+  birth_record child;
+  if (!apply_outcome(population, index1, index2,
+                     encounter_outcome_at(population, index1, index2),
+                     child)) {
+    return false;
+  }
+  population.add(child.species, child.diet, child.vitality);
+  return true;
+}
+
+// Seria spotkań par o podanych indeksach, w kolejności. Dzieci trafiają na
+// koniec populacji; zwraca liczbę urodzonych. Organizm może spotkać sam
+// siebie: to ten sam gatunek (reguła 4), tak samo jak w Ecosystem.
+template <typename species_t, typename policy_t>
+size_t encounter_batch(Population<species_t, policy_t> &population,
+                       span<const encounter_pair_t> pairs) {
+  size_t births = 0;
+  for (const auto &[index1, index2] : pairs) {
+    births += encounter_in_place(population, index1, index2);
+  }
+  return births;
+}
+
+// Odpowiednik szablonu encounter_series_counted dla organizmów z populacji:
+// organizm hunter spotyka po kolei organizmy z prey, aż do swojej śmierci.
+// Populacja się nie zmienia, a wynikiem jest witalność, którą miałby hunter
+// po wszystkich spotkaniach, i liczba spotkań, które się odbyły.
+// Tu hunter zaczyna od podanej witalności zamiast od tej z populacji, np.
+// przy dokańczaniu serii przerwanej po części prey.
+template <typename species_t, typename policy_t>
+series_result<typename policy_t::value_type> encounter_series_counted(
+    const Population<species_t, policy_t> &population,
+    population_index_t hunter, typename policy_t::value_type vitality,
+    span<const population_index_t> prey) {
+  using vitality_type = typename policy_t::value_type;
+  const species_handle species = population.get_species_handle(hunter);
+  const Diet diet = population.get_diet(hunter);
+  size_t encounters = 0;
+  for (; encounters < prey.size() && vitality != 0; ++encounters) {
+    const population_index_t other = prey[encounters];
+    const Diet other_diet = population.get_diet(other);
+    if (diet_is_plant(diet) && diet_is_plant(other_diet)) {
+      throw logic_error("Two plants cannot meet");
+    }
+    vitality_type other_vitality = population.get_vitality(other);
+    vitality_type child_vitality;
+    const bool same_species =
+        diet == other_diet && species == population.get_species_handle(other);
+    const bool eats1 = diet_can_eat(diet, other_diet);
+    const bool eats2 = diet_can_eat(other_diet, diet);
+    if constexpr (encounter_counters_enabled) {
+      count_encounter_rule(encounter_lane_rule(
+          vitality, other_vitality, same_species, eats1, eats2,
+          diet_is_plant(diet), diet_is_plant(other_diet)));
+    }
+    encounter_lane<policy_t>(vitality, other_vitality, same_species, eats1,
+                             eats2, diet_is_plant(diet),
+                             diet_is_plant(other_diet), child_vitality);
+  }
+  return {vitality, encounters};
+}
+
+template <typename species_t, typename policy_t>
+series_result<typename policy_t::value_type> encounter_series_counted(
+    const Population<species_t, policy_t> &population,
+    population_index_t hunter, span<const population_index_t> prey) {
+  return encounter_series_counted(population, hunter,
+                                  population.get_vitality(hunter), prey);
+}
+
+template <typename species_t, typename policy_t>
+typename policy_t::value_type encounter_series(
+    const Population<species_t, policy_t> &population,
+    population_index_t hunter, span<const population_index_t> prey) {
+  return encounter_series_counted(population, hunter, prey).hunter;
+}
+
+// Wersja, w której dzieci trafiają do areny zamiast do populacji; można je
+// dopisać później przez add_births. Pary nie mogą więc dotyczyć dzieci z tej
+// samej serii.
+template <typename species_t, typename policy_t>
+size_t encounter_batch(Population<species_t, policy_t> &population,
+                       span<const encounter_pair_t> pairs,
+                       BirthArena &births) {
+  const size_t births_before = births.size();
+  birth_record child;
+  for (const auto &[index1, index2] : pairs) {
+    if (apply_outcome(population, index1, index2,
+                      encounter_outcome_at(population, index1, index2),
+                      child)) {
+      births.push(child);
+    }
+  }
+  return births.size() - births_before;
+}
+
+// To samo co encounter_batch, ale po encounter_lanes spotkań naraz, bez
+// rozgałęzień zależnych od witalności. Grupy, w których organizm się powtarza
+// albo spotykają się dwie rośliny, są liczone po kolei funkcją
+// encounter_in_place. Pary mogą odnosić się tylko do organizmów, które już
+// są w populacji; dzieci z grupy są dopisywane po jej przetworzeniu. Przy
+// checked_vitality grupy, w których suma witalności pary mogłaby się
+// przepełnić, też są liczone po kolei, żeby wyjątek padł przy właściwej parze.
+template <typename species_t, typename policy_t>
+size_t encounter_batch_simd(Population<species_t, policy_t> &population,
+                            span<const encounter_pair_t> pairs) {
+  using vitality_type = typename policy_t::value_type;
+  size_t births = 0;
+  size_t start = 0;
+  for (; start + encounter_lanes <= pairs.size(); start += encounter_lanes) {
+    const auto group = pairs.subspan(start, encounter_lanes);
+    alignas(64) uint64_t index1[encounter_lanes];
+    alignas(64) uint64_t index2[encounter_lanes];
+    alignas(64) vitality_type child_vitality[encounter_lanes];
+    encounter_lane_flags flags;
+    bool vectorizable = true;
+
+    for (size_t lane = 0; lane < encounter_lanes; ++lane) {
+      const auto [i1, i2] = group[lane];
+      index1[lane] = i1;
+      index2[lane] = i2;
+      vectorizable &= i1 != i2 && i1 < population.size() &&
+                      i2 < population.size();
+      for (size_t other = 0; other < lane; ++other) {
+        vectorizable &= index1[other] != i1 && index1[other] != i2 &&
+                        index2[other] != i1 && index2[other] != i2;
+      }
+      if (!vectorizable) {
+        break;
+      }
+
+      const Diet diet1 = population.get_diet(i1);
+      const Diet diet2 = population.get_diet(i2);
+      vectorizable &= !diet_is_plant(diet1) || !diet_is_plant(diet2);
+      if constexpr (policy_t::overflow == VitalityOverflow::check) {
+        vectorizable &= population.get_vitality(i2) <=
+                        vitality_max<policy_t>() - population.get_vitality(i1);
+      }
+      const uint8_t bit = 1 << lane;
+      flags.same_species |=
+          (diet1 == diet2 && population.get_species_handle(i1) ==
+                                  population.get_species_handle(i2)) *
+          bit;
+      flags.eats1 |= diet_can_eat(diet1, diet2) * bit;
+      flags.eats2 |= diet_can_eat(diet2, diet1) * bit;
+      flags.plant1 |= diet_is_plant(diet1) * bit;
+      flags.plant2 |= diet_is_plant(diet2) * bit;
+    }
+
+    if (!vectorizable) {
+      births += encounter_batch(population, group);
+      continue;
+    }
+
+    if constexpr (encounter_counters_enabled) {
+      for (size_t lane = 0; lane < encounter_lanes; ++lane) {
+        auto bit = [lane](uint8_t mask) {
+          return ((mask >> lane) & 1) != 0;
+        };
+        count_encounter_rule(encounter_lane_rule(
+            population.get_vitality(index1[lane]),
+            population.get_vitality(index2[lane]), bit(flags.same_species),
+            bit(flags.eats1), bit(flags.eats2), bit(flags.plant1),
+            bit(flags.plant2)));
+      }
+    }
+
+    size_t deaths = 0;
+    const uint8_t born =
+        encounter_group_simd<policy_t>(population.get_vitalities().data(),
+                                       index1, index2, flags, child_vitality,
+                                       deaths);
+    population.record_deaths(deaths);
+    for (size_t lane = 0; lane < encounter_lanes; ++lane) {
+      if ((born >> lane) & 1) {
+        const auto i1 = static_cast<population_index_t>(index1[lane]);
+        population.add(population.get_species_handle(i1),
+                       population.get_diet(i1), child_vitality[lane]);
+        count_offspring();
+        ++births;
+      }
+    }
+  }
+  return births + encounter_batch(population, pairs.subspan(start));
+}
+
+// Liczba kubełków encounter_batch_bucketed: po jednym na parę diet.
+inline constexpr size_t diet_buckets = 16;
+
+constexpr size_t diet_bucket(Diet diet1, Diet diet2) {
+  return static_cast<size_t>(diet1) * 4 + static_cast<size_t>(diet2);
+}
+
+// Dziecko z pary o numerze pair, dopisywane po przetworzeniu wszystkich
+// kubełków.
+template <typename vitality_type>
+struct bucket_birth {
+  size_t pair;
+  vitality_type vitality;
+};
+
+// Spotkania par z jednego kubełka; diety są znane w czasie kompilacji, więc
+// pętla nie sprawdza ich wcale. Dzieci trafiają do born[born_count], a
+// born_count rośnie o jeden tylko przy urodzeniu, też bez skoku.
+template <size_t bucket, typename species_t, typename policy_t>
+void encounter_diet_bucket(
+    Population<species_t, policy_t> &population,
+    span<const encounter_pair_t> pairs, span<const size_t> order,
+    bucket_birth<typename policy_t::value_type> *born, size_t &born_count,
+    size_t &deaths) {
+  using vitality_type = typename policy_t::value_type;
+  constexpr Diet diet1 = static_cast<Diet>(bucket / 4);
+  constexpr Diet diet2 = static_cast<Diet>(bucket % 4);
+  constexpr bool eats1 = diet_can_eat(diet1, diet2);
+  constexpr bool eats2 = diet_can_eat(diet2, diet1);
+  constexpr bool plant1 = diet_is_plant(diet1);
+  constexpr bool plant2 = diet_is_plant(diet2);
+  const auto vitalities = population.get_vitalities();
+  const auto species = population.get_species_handles();
+  for (const size_t pair : order) {
+    const auto [index1, index2] = pairs[pair];
+    vitality_type v1 = vitalities[index1];
+    vitality_type v2 = vitalities[index2];
+    const bool alive1 = v1 != 0;
+    const bool alive2 = v2 != 0;
+    const bool same_species =
+        diet1 == diet2 && species[index1] == species[index2];
+    if constexpr (encounter_counters_enabled) {
+      count_encounter_rule(encounter_lane_rule(v1, v2, same_species, eats1,
+                                               eats2, plant1, plant2));
+    }
+    vitality_type child_vitality;
+    const bool has_child =
+        encounter_lane<policy_t>(v1, v2, same_species, eats1, eats2, plant1,
+                                 plant2, child_vitality);
+    born[born_count] = {pair, child_vitality};
+    born_count += has_child;
+    deaths += (alive1 && v1 == 0) + (alive2 && v2 == 0);
+    vitalities[index1] = v1;
+    vitalities[index2] = v2;
+  }
+}
+
+template <typename species_t, typename policy_t, size_t... buckets>
+constexpr auto diet_bucket_kernels(std::index_sequence<buckets...>) {
+  return std::array{&encounter_diet_bucket<buckets, species_t, policy_t>...};
+}
+
+// Czy któryś organizm występuje w pairs więcej niż raz. Koszt zależy tylko od
+// liczby par: bitmapa organizmów, jeśli jest najwyżej 64 razy większa od
+// liczby par (tyle słów co par), a inaczej posortowane numery.
+inline bool pairs_overlap(span<const encounter_pair_t> pairs,
+                          size_t population_size) {
+  if (population_size <= 64 * pairs.size()) {
+    vector<bool> seen(population_size);
+    for (const auto &[index1, index2] : pairs) {
+      if (index1 == index2 || seen[index1] || seen[index2]) {
+        return true;
+      }
+      seen[index1] = true;
+      seen[index2] = true;
+    }
+    return false;
+  }
+  vector<population_index_t> indices;
+  indices.reserve(2 * pairs.size());
+  for (const auto &[index1, index2] : pairs) {
+    indices.push_back(index1);
+    indices.push_back(index2);
+  }
+  std::sort(indices.begin(), indices.end());
+  return std::adjacent_find(indices.begin(), indices.end()) != indices.end();
+}
+
+// To samo co encounter_batch, ale pary są najpierw rozkładane sortowaniem
+// kubełkowym według par diet (jedno przejście zliczające), a każdy kubełek
+// liczy osobna wersja jądra. W ten sposób w jednej pętli wszystkie spotkania
+// idą tą samą ścieżką reguł. Pary mogą odnosić się tylko do organizmów, które
+// już są w populacji; dzieci są dopisywane na końcu, w kolejności par.
+// Pary spoza populacji i pary dwóch roślin są odrzucane, zanim cokolwiek się
+// zmieni. Kolejność kubełków zmieniłaby wynik par, w których organizm się
+// powtarza, więc takie serie, a przy checked_vitality wszystkie (wyjątek musi
+// paść przy właściwej parze), liczy po kolei encounter_batch.
+template <typename species_t, typename policy_t>
+size_t encounter_batch_bucketed(Population<species_t, policy_t> &population,
+                                span<const encounter_pair_t> pairs) {
+  using vitality_type = typename policy_t::value_type;
+  if constexpr (policy_t::overflow == VitalityOverflow::check) {
+    return encounter_batch(population, pairs);
+  } else {
+    std::array<size_t, diet_buckets + 1> begin{};
+    vector<uint8_t> keys(pairs.size());
+    for (size_t pair = 0; pair < pairs.size(); ++pair) {
+      const auto [index1, index2] = pairs[pair];
+      if (index1 >= population.size() || index2 >= population.size()) {
+        throw out_of_range("Pair outside the population");
+      }
+      keys[pair] = static_cast<uint8_t>(diet_bucket(
+          population.get_diet(index1), population.get_diet(index2)));
+      ++begin[keys[pair] + 1];
+    }
+    if (begin[diet_bucket(Diet::plant, Diet::plant) + 1] != 0) {
+      throw logic_error("Two plants cannot meet");
+    }
+    if (pairs_overlap(pairs, population.size())) {
+      return encounter_batch(population, pairs);
+    }
+    for (size_t bucket = 0; bucket < diet_buckets; ++bucket) {
+      begin[bucket + 1] += begin[bucket];
+    }
+    vector<size_t> order(pairs.size());
+    std::array<size_t, diet_buckets> next;
+    std::copy(begin.begin(), begin.end() - 1, next.begin());
+    for (size_t pair = 0; pair < pairs.size(); ++pair) {
+      order[next[keys[pair]]++] = pair;
+    }
+
+    static constexpr auto kernels = diet_bucket_kernels<species_t, policy_t>(
+        std::make_index_sequence<diet_buckets>{});
+    // Jedno miejsce zapasu na zapis z ostatniej pary bez dziecka.
+    vector<bucket_birth<vitality_type>> born(pairs.size() + 1);
+    size_t born_count = 0;
+    size_t deaths = 0;
+    for (size_t bucket = 0; bucket < diet_buckets; ++bucket) {
+      kernels[bucket](population, pairs,
+                      span<const size_t>(order).subspan(
+                          begin[bucket], begin[bucket + 1] - begin[bucket]),
+                      born.data(), born_count, deaths);
+    }
+    population.record_deaths(deaths);
+
+    // Dzieci z jednego kubełka są w kolejności par, ale kubełki trzeba
+    // jeszcze ze sobą przepleść.
+    std::sort(born.begin(), born.begin() + born_count,
+              [](const auto &a, const auto &b) { return a.pair < b.pair; });
+    population.reserve_additional(born_count);
+    for (size_t i = 0; i < born_count; ++i) {
+      const population_index_t parent = pairs[born[i].pair].first;
+      population.add(population.get_species_handle(parent),
+                     population.get_diet(parent), born[i].vitality);
+      count_offspring();
+    }
+    return born_count;
+  }
+}
+
+#endif  // JNP1_POPULATION_H
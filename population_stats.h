@@ -0,0 +1,185 @@
+#ifndef JNP1_POPULATION_STATS_H
+#define JNP1_POPULATION_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "organism.h"
+#include "population.h"
+#include "species_registry.h"
+#include "thread_pool.h"
+
+// Liczby żywych organizmów i sumy ich witalności (biomasa): całej populacji,
+// każdego gatunku i każdej diety, z odpowiedzią w czasie stałym. Raz
+// policzone przeglądem populacji, potem są poprawiane o zmiany: spotkania
+// z encounter_round przez recorder i commit, a organizmy dopisane poza rundą
+// przez add. Dzieci są brane z populacji dopiero w commit, bo przy
+// carrying_capacity nie wszystkie urodzone zostają dopisane. Biomasa jest
+// liczona modulo 2^64, tak jak dodawanie wrapping_vitality; dla węższych
+// witalności wynik jest dokładny.
+class PopulationStatistics {
+  static constexpr size_t diet_count = 4;
+
+  // Zmiana liczby żywych i biomasy jednej grupy; obie w jednej linii pamięci.
+  struct group_delta {
+    int64_t live = 0;
+    uint64_t biomass = 0;
+
+    void add(int64_t live_change, uint64_t biomass_change) {
+      live += live_change;
+      biomass += biomass_change;
+    }
+  };
+
+  // Zmiany policzone przez jeden wątek w trakcie rundy, dla par (gatunek,
+  // dieta). Jedna grupa na organizm zamiast osobnych sum gatunku i diety
+  // oznacza o połowę mniej zapisów przy każdym spotkaniu; sumy gatunków i diet
+  // powstają z grup dopiero w commit.
+  struct alignas(64) statistics_delta {
+    vector<group_delta> groups;
+
+    void change(species_handle species, Diet diet, uint64_t old_vitality,
+                uint64_t new_vitality) {
+      groups[species.id * diet_count + static_cast<size_t>(diet)].add(
+          (new_vitality != 0) - (old_vitality != 0),
+          new_vitality - old_vitality);
+    }
+  };
+
+  vector<uint64_t> species_live;
+  vector<uint64_t> species_biomass;
+  std::array<uint64_t, diet_count> diet_live{};
+  std::array<uint64_t, diet_count> diet_biomass{};
+  vector<statistics_delta> deltas;
+
+  void ensure_species(species_handle species) {
+    if (species.id >= species_live.size()) {
+      species_live.resize(species.id + 1);
+      species_biomass.resize(species.id + 1);
+    }
+  }
+
+ public:
+  PopulationStatistics() = default;
+
+  template <typename species_t, typename policy_t>
+  explicit PopulationStatistics(
+      const Population<species_t, policy_t> &population) {
+    rebuild(population);
+  }
+
+  // Liczy wszystko od nowa jednym przeglądem populacji.
+  template <typename species_t, typename policy_t>
+  void rebuild(const Population<species_t, policy_t> &population) {
+    species_live.assign(population.get_registry().size(), 0);
+    species_biomass.assign(population.get_registry().size(), 0);
+    diet_live = {};
+    diet_biomass = {};
+    for (population_index_t index = 0; index < population.size(); ++index) {
+      add(population.get_species_handle(index), population.get_diet(index),
+          population.get_vitality(index));
+    }
+  }
+
+  // Organizm dopisany do populacji poza encounter_round.
+  void add(species_handle species, Diet diet, uint64_t vitality) {
+    ensure_species(species);
+    const size_t live = vitality != 0;
+    species_live[species.id] += live;
+    species_biomass[species.id] += vitality;
+    diet_live[static_cast<size_t>(diet)] += live;
+    diet_biomass[static_cast<size_t>(diet)] += vitality;
+  }
+
+  uint64_t live_count() const {
+    uint64_t total = 0;
+    for (const uint64_t count : diet_live) {
+      total += count;
+    }
+    return total;
+  }
+
+  uint64_t biomass() const {
+    uint64_t total = 0;
+    for (const uint64_t sum : diet_biomass) {
+      total += sum;
+    }
+    return total;
+  }
+
+  uint64_t live_count(species_handle species) const {
+    return species.id < species_live.size() ? species_live[species.id] : 0;
+  }
+
+  uint64_t biomass(species_handle species) const {
+    return species.id < species_biomass.size() ? species_biomass[species.id]
+                                               : 0;
+  }
+
+  uint64_t live_count(Diet diet) const {
+    return diet_live[static_cast<size_t>(diet)];
+  }
+
+  uint64_t biomass(Diet diet) const {
+    return diet_biomass[static_cast<size_t>(diet)];
+  }
+
+  // Obserwator dla encounter_round. Każdy wątek puli zbiera zmiany witalności
+  // (także zabitych) we własnym liczniku, bez synchronizacji; po rundzie
+  // trzeba wywołać commit.
+  template <typename species_t, typename policy_t>
+  auto recorder(const Population<species_t, policy_t> &population,
+                const ThreadPool &pool) {
+    const size_t species_count = population.get_registry().size();
+    deltas.resize(pool.size());
+    for (auto &delta : deltas) {
+      delta.groups.assign(species_count * diet_count, {});
+    }
+    // Obserwator jest wołany przed zapisaniem nowych witalności, więc
+    // population ma jeszcze stare.
+    return [this, &population](size_t worker, population_index_t index1,
+                               population_index_t index2,
+                               const auto &outcome) {
+      statistics_delta &delta = deltas[worker];
+      delta.change(population.get_species_handle(index1),
+                   population.get_diet(index1),
+                   population.get_vitality(index1), outcome.vitality1);
+      delta.change(population.get_species_handle(index2),
+                   population.get_diet(index2),
+                   population.get_vitality(index2), outcome.vitality2);
+    };
+  }
+
+  // Dolicza zmiany zebrane przez recorder od ostatniego commit i born
+  // ostatnich organizmów populacji, czyli dzieci dopisane przez
+  // encounter_round (jej wynik).
+  template <typename species_t, typename policy_t>
+  void commit(const Population<species_t, policy_t> &population,
+              size_t born) {
+    for (auto &delta : deltas) {
+      const size_t species_count = delta.groups.size() / diet_count;
+      if (species_count > 0) {
+        ensure_species({static_cast<uint32_t>(species_count - 1)});
+      }
+      for (size_t group = 0; group < delta.groups.size(); ++group) {
+        const size_t id = group / diet_count;
+        const size_t diet = group % diet_count;
+        species_live[id] += delta.groups[group].live;
+        species_biomass[id] += delta.groups[group].biomass;
+        diet_live[diet] += delta.groups[group].live;
+        diet_biomass[diet] += delta.groups[group].biomass;
+      }
+      std::fill(delta.groups.begin(), delta.groups.end(), group_delta{});
+    }
+    for (size_t index = population.size() - born; index < population.size();
+         ++index) {
+      add(population.get_species_handle(index), population.get_diet(index),
+          population.get_vitality(index));
+    }
+  }
+};
+
+#endif  // JNP1_POPULATION_STATS_H
@@ -0,0 +1,220 @@
+#ifndef JNP1_SCHEDULER_H
+#define JNP1_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "counter_rng.h"
+#include "population.h"
+#include "thread_pool.h"
+
+// Tyle par liczy jedno zadanie w puli wątków. Podział nie zależy od liczby
+// wątków, dzięki czemu dzieci są dopisywane zawsze w tej samej kolejności.
+inline constexpr size_t round_chunk_size = 4096;
+
+// Pary kolejnych organizmów z order (zakres numerów organizmów). Pary dwóch
+// roślin są pomijane, bo rośliny nie mogą się spotkać.
+template <typename species_t, typename policy_t, typename order_t>
+vector<encounter_pair_t> match_consecutive(
+    const Population<species_t, policy_t> &population, const order_t &order) {
+  vector<encounter_pair_t> pairs;
+  pairs.reserve(order.size() / 2);
+  for (size_t i = 0; i + 1 < order.size(); i += 2) {
+    const population_index_t index1 = order[i];
+    const population_index_t index2 = order[i + 1];
+    if (!diet_is_plant(population.get_diet(index1)) ||
+        !diet_is_plant(population.get_diet(index2))) {
+      pairs.emplace_back(index1, index2);
+    }
+  }
+  return pairs;
+}
+
+// Losowe skojarzenie żywych organizmów w rozłączne pary.
+template <typename species_t, typename policy_t>
+vector<encounter_pair_t> random_matching(
+    const Population<species_t, policy_t> &population,
+    std::mt19937_64 &generator) {
+  vector<population_index_t> order;
+  order.reserve(population.size());
+  for (population_index_t index = 0; index < population.size(); ++index) {
+    if (!population.is_dead(index)) {
+      order.push_back(index);
+    }
+  }
+  std::shuffle(order.begin(), order.end(), generator);
+  return match_consecutive(population, order);
+}
+
+// To samo z generatorem licznikowym: w rundzie round organizm index dostaje
+// klucz rng(round, index), a pary tworzą kolejne organizmy w porządku kluczy.
+// Klucze liczą i sortują fragmentami wątki puli, a posortowane fragmenty są
+// scalane parami. Porządek (klucz, numer) jest liniowy, więc skojarzenie jest
+// identyczne dla każdej liczby wątków.
+template <typename species_t, typename policy_t>
+vector<encounter_pair_t> random_matching(
+    const Population<species_t, policy_t> &population, const CounterRng &rng,
+    uint64_t round, ThreadPool &pool) {
+  using keyed_index_t = std::pair<uint64_t, population_index_t>;
+  const size_t chunks =
+      (population.size() + round_chunk_size - 1) / round_chunk_size;
+  vector<vector<keyed_index_t>> runs(std::max<size_t>(chunks, 1));
+  pool.parallel_for(chunks, [&](size_t chunk, size_t) {
+    const size_t end =
+        std::min(population.size(), (chunk + 1) * round_chunk_size);
+    vector<keyed_index_t> &run = runs[chunk];
+    run.reserve(end - chunk * round_chunk_size);
+    for (size_t index = chunk * round_chunk_size; index < end; ++index) {
+      if (!population.is_dead(index)) {
+        run.emplace_back(rng(round, index), index);
+      }
+    }
+    std::sort(run.begin(), run.end());
+  });
+
+  while (runs.size() > 1) {
+    vector<vector<keyed_index_t>> merged((runs.size() + 1) / 2);
+    pool.parallel_for(merged.size(), [&](size_t task, size_t) {
+      if (2 * task + 1 == runs.size()) {
+        merged[task] = std::move(runs[2 * task]);
+        return;
+      }
+      const auto &left = runs[2 * task];
+      const auto &right = runs[2 * task + 1];
+      merged[task].resize(left.size() + right.size());
+      std::merge(left.begin(), left.end(), right.begin(), right.end(),
+                 merged[task].begin());
+    });
+    runs = std::move(merged);
+  }
+
+  struct index_view {
+    const vector<keyed_index_t> &keyed;
+
+    size_t size() const {
+      return keyed.size();
+    }
+
+    population_index_t operator[](size_t i) const {
+      return keyed[i].second;
+    }
+  };
+  return match_consecutive(population, index_view{runs[0]});
+}
+
+// Spotkania rozłącznych par, rozdzielone między wątki puli. Pary nie mają
+// wspólnych organizmów, więc nie potrzeba blokad; dzieci trafiają do aren
+// poszczególnych wątków w births i są dopisywane do populacji po zakończeniu
+// rundy, w kolejności par, o ile mieszczą się w carrying_capacity populacji.
+// Areny są czyszczone na początku rundy, więc warto używać tego samego births
+// we wszystkich rundach. Zwraca liczbę dzieci dopisanych do populacji.
+// Skutek każdego spotkania dostaje observe(worker, index1, index2, outcome),
+// wołane z wątku, który je policzył.
+template <typename species_t, typename policy_t,
+          typename observer_t = no_encounter_observer>
+size_t encounter_round(Population<species_t, policy_t> &population,
+                       span<const encounter_pair_t> pairs, ThreadPool &pool,
+                       RoundBirths &births, observer_t &&observe = {}) {
+  const size_t chunks =
+      (pairs.size() + round_chunk_size - 1) / round_chunk_size;
+  births.reset(pool.size(), chunks);
+  std::atomic<size_t> deaths = 0;
+
+  pool.parallel_for(chunks, [&](size_t chunk, size_t worker) {
+    const auto chunk_pairs = pairs.subspan(
+        chunk * round_chunk_size,
+        std::min(round_chunk_size, pairs.size() - chunk * round_chunk_size));
+    BirthArena &arena = births.arena(worker);
+    const size_t begin = arena.size();
+    birth_record child;
+    size_t chunk_deaths = 0;
+    auto observe_worker = [&](population_index_t index1,
+                              population_index_t index2, const auto &outcome) {
+      observe(worker, index1, index2, outcome);
+    };
+    for (const auto &[index1, index2] : chunk_pairs) {
+      if (encounter_rules(population, index1, index2, child, chunk_deaths,
+                          observe_worker)) {
+        arena.push(child);
+      }
+    }
+    births.set_chunk(chunk, worker, begin, arena.size());
+    deaths += chunk_deaths;
+  });
+
+  population.record_deaths(deaths);
+  return population.add_births(births);
+}
+
+template <typename species_t, typename policy_t,
+          typename observer_t = no_encounter_observer>
+size_t encounter_round(Population<species_t, policy_t> &population,
+                       span<const encounter_pair_t> pairs, ThreadPool &pool,
+                       observer_t &&observe = {}) {
+  RoundBirths births(pool.size());
+  return encounter_round(population, pairs, pool, births,
+                         std::forward<observer_t>(observe));
+}
+
+// Runda, w której każdy żywy organizm spotyka losowego partnera.
+template <typename species_t, typename policy_t>
+size_t simulate_round(Population<species_t, policy_t> &population,
+                      std::mt19937_64 &generator, ThreadPool &pool,
+                      RoundBirths &births) {
+  const auto pairs = random_matching(population, generator);
+  return encounter_round(population, span(pairs), pool, births);
+}
+
+template <typename species_t, typename policy_t>
+size_t simulate_round(Population<species_t, policy_t> &population,
+                      std::mt19937_64 &generator, ThreadPool &pool) {
+  RoundBirths births(pool.size());
+  return simulate_round(population, generator, pool, births);
+}
+
+// Runda numer round ze skojarzeniem z generatora licznikowego. Przebieg
+// kolejnych rund zależy tylko od rng i numerów rund, a nie od liczby wątków.
+template <typename species_t, typename policy_t>
+size_t simulate_round(Population<species_t, policy_t> &population,
+                      const CounterRng &rng, uint64_t round, ThreadPool &pool,
+                      RoundBirths &births) {
+  const auto pairs = random_matching(population, rng, round, pool);
+  return encounter_round(population, span(pairs), pool, births);
+}
+
+template <typename species_t, typename policy_t>
+size_t simulate_round(Population<species_t, policy_t> &population,
+                      const CounterRng &rng, uint64_t round, ThreadPool &pool) {
+  RoundBirths births(pool.size());
+  return simulate_round(population, rng, round, pool, births);
+}
+
+// Seria spotkań jednego organizmu, jak w encounter_series.
+struct encounter_chain {
+  population_index_t hunter;
+  span<const population_index_t> prey;
+};
+
+// Niezależne serie spotkań liczone równolegle, każda po kolei w jednym wątku.
+// Serie mogą mieć bardzo różne długości, dlatego każda jest osobnym zadaniem
+// puli, a wątki bez pracy podkradają je innym. Zwraca końcowe witalności
+// organizmów hunter w kolejności serii; populacja się nie zmienia.
+template <typename species_t, typename policy_t>
+vector<typename policy_t::value_type> encounter_series_parallel(
+    const Population<species_t, policy_t> &population,
+    span<const encounter_chain> chains, ThreadPool &pool) {
+  vector<typename policy_t::value_type> results(chains.size());
+  pool.parallel_for(chains.size(), [&](size_t chain, size_t) {
+    results[chain] = encounter_series(population, chains[chain].hunter,
+                                      chains[chain].prey);
+  });
+  return results;
+}
+
+#endif  // JNP1_SCHEDULER_H
@@ -0,0 +1,326 @@
+#ifndef JNP1_SHARDING_H
+#define JNP1_SHARDING_H
+
+#include <algorithm>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "birth_arena.h"
+#include "counter_rng.h"
+#include "organism.h"
+#include "population.h"
+#include "snapshot.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
+
+// Symulacja rozłożona na kilka procesów (shardów), każdy z własną populacją
+// i siatką. Siatka jest podzielona na pasy wierszy, po jednym na shard.
+// Spotkania odbywają się tylko wewnątrz shardu, więc w parzystych rundach
+// granice pasów leżą o wiersz niżej niż w nieparzystych: organizmy
+// z brzegowego wiersza przechodzą wtedy do sąsiada i mogą spotkać tych, którzy
+// w poprzedniej rundzie byli po drugiej stronie granicy. Między rundami
+// przesyłane są więc tylko organizmy z brzegowych wierszy i te, które same
+// przeszły do cudzego pasa.
+
+// Łącze między shardami. send nie może czekać na odbiór wiadomości, a
+// wiadomości od jednego nadawcy do jednego odbiorcy przychodzą w kolejności
+// wysłania. Tak zachowuje się np. MPI_Isend z MPI_Recv; w tym pliku jest
+// tylko LocalTransport dla shardów będących wątkami jednego procesu.
+template <typename T>
+concept shard_transport = requires(T &transport, const T &const_transport,
+                                   std::vector<std::byte> message) {
+  { const_transport.rank() } -> std::convertible_to<size_t>;
+  { const_transport.size() } -> std::convertible_to<size_t>;
+  transport.send(size_t{}, std::move(message));
+  { transport.receive(size_t{}) } -> std::same_as<std::vector<std::byte>>;
+};
+
+// Skrzynki na wiadomości między ranks shardami jednego procesu.
+class LocalNetwork {
+  struct mailbox {
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::deque<std::vector<std::byte>> messages;
+  };
+
+  size_t ranks;
+  std::unique_ptr<mailbox[]> mailboxes;
+
+ public:
+  explicit LocalNetwork(size_t ranks)
+      : ranks(ranks), mailboxes(std::make_unique<mailbox[]>(ranks * ranks)) {
+  }
+
+  size_t size() const {
+    return ranks;
+  }
+
+  void send(size_t from, size_t to, std::vector<std::byte> message) {
+    mailbox &box = mailboxes[from * ranks + to];
+    {
+      std::lock_guard lock(box.mutex);
+      box.messages.push_back(std::move(message));
+    }
+    box.arrived.notify_one();
+  }
+
+  std::vector<std::byte> receive(size_t from, size_t to) {
+    mailbox &box = mailboxes[from * ranks + to];
+    std::unique_lock lock(box.mutex);
+    box.arrived.wait(lock, [&] { return !box.messages.empty(); });
+    std::vector<std::byte> message = std::move(box.messages.front());
+    box.messages.pop_front();
+    return message;
+  }
+};
+
+class LocalTransport {
+  LocalNetwork *network;
+  size_t own_rank;
+
+ public:
+  LocalTransport(LocalNetwork &network, size_t rank)
+      : network(&network), own_rank(rank) {
+    if (rank >= network.size()) {
+      throw out_of_range("Unknown rank");
+    }
+  }
+
+  size_t rank() const {
+    return own_rank;
+  }
+
+  size_t size() const {
+    return network->size();
+  }
+
+  void send(size_t to, std::vector<std::byte> message) {
+    network->send(own_rank, to, std::move(message));
+  }
+
+  std::vector<std::byte> receive(size_t from) {
+    return network->receive(from, own_rank);
+  }
+};
+
+// Pierwszy wiersz pasa shardu rank w rundzie round; pas kończy się tam, gdzie
+// zaczyna się pas następnego shardu (dla rank == ranks: rows).
+constexpr uint32_t shard_first_row(size_t rank, size_t ranks, uint32_t rows,
+                                   uint64_t round) {
+  if (rank == 0) {
+    return 0;
+  }
+  if (rank == ranks) {
+    return rows;
+  }
+  return static_cast<uint32_t>(rank * rows / ranks + round % 2);
+}
+
+// Shard, do którego należy wiersz row w rundzie round.
+constexpr size_t shard_of_row(uint32_t row, size_t ranks, uint32_t rows,
+                              uint64_t round) {
+  size_t rank = std::min<size_t>(ranks - 1, size_t{row} * ranks / rows);
+  while (rank > 0 && row < shard_first_row(rank, ranks, rows, round)) {
+    --rank;
+  }
+  while (row >= shard_first_row(rank + 1, ranks, rows, round)) {
+    ++rank;
+  }
+  return rank;
+}
+
+// Wiadomość z organizmami przechodzącymi do innego shardu: długość zrzutu
+// (uint64_t), od bajtu snapshot_alignment zrzut populacji w formacie
+// z snapshot.h, a za nim, od granicy snapshot_alignment, ich położenia.
+template <snapshot_species species_t, typename policy_t>
+std::vector<std::byte> pack_migrants(
+    const Population<species_t, policy_t> &migrants,
+    std::span<const grid_position> positions) {
+  std::ostringstream out;
+  write_snapshot(out, migrants);
+  const std::string snapshot = std::move(out).str();
+  const uint64_t snapshot_size = snapshot.size();
+  const size_t positions_offset =
+      snapshot_align(snapshot_alignment + snapshot_size);
+  std::vector<std::byte> message(positions_offset +
+                                 positions.size_bytes());
+  std::memcpy(message.data(), &snapshot_size, sizeof(snapshot_size));
+  // Pusta lista położeń ma data() == nullptr, którego nie wolno podać
+  // memcpy nawet z zerową długością.
+  const auto snapshot_bytes = std::as_bytes(std::span(snapshot));
+  std::copy(snapshot_bytes.begin(), snapshot_bytes.end(),
+            message.begin() + snapshot_alignment);
+  const auto position_bytes = std::as_bytes(positions);
+  std::copy(position_bytes.begin(), position_bytes.end(),
+            message.begin() + positions_offset);
+  return message;
+}
+
+template <snapshot_species species_t, vitality_policy policy_t =
+                                          wrapping_vitality,
+          shard_transport transport_t = LocalTransport>
+class Shard {
+  transport_t &transport;
+  Population<species_t, policy_t> population;
+  SpatialGrid grid;
+  RoundBirths births;
+
+  size_t owner(population_index_t index, uint64_t round) const {
+    return shard_of_row(grid.cell_of(index).second, transport.size(),
+                        grid.get_rows(), round);
+  }
+
+  // Dopisuje organizmy z wiadomości pack_migrants.
+  size_t unpack_migrants(std::span<const std::byte> message) {
+    uint64_t snapshot_size;
+    if (message.size() < snapshot_alignment) {
+      throw invalid_argument("Corrupted migrants");
+    }
+    std::memcpy(&snapshot_size, message.data(), sizeof(snapshot_size));
+    if (snapshot_size > message.size() - snapshot_alignment) {
+      throw invalid_argument("Corrupted migrants");
+    }
+    // Transport daje pamięć wyrównaną zwykle tylko do max_align_t, a zrzut
+    // musi zaczynać się od granicy snapshot_alignment.
+    std::span<const std::byte> snapshot_bytes =
+        message.subspan(snapshot_alignment, snapshot_size);
+    vector<snapshot_block> aligned;
+    if (reinterpret_cast<uintptr_t>(snapshot_bytes.data()) %
+            snapshot_alignment !=
+        0) {
+      aligned.resize((snapshot_size + snapshot_alignment - 1) /
+                     snapshot_alignment);
+      const auto copy = std::as_writable_bytes(std::span(aligned));
+      std::copy(snapshot_bytes.begin(), snapshot_bytes.end(), copy.begin());
+      snapshot_bytes = copy.first(snapshot_size);
+    }
+    const PopulationSnapshot<species_t, policy_t> snapshot(snapshot_bytes);
+    const size_t positions_offset =
+        snapshot_align(snapshot_alignment + snapshot_size);
+    if (message.size() !=
+        positions_offset + snapshot.size() * sizeof(grid_position)) {
+      throw invalid_argument("Corrupted migrants");
+    }
+
+    vector<species_handle> local(snapshot.species_count());
+    for (uint32_t id = 0; id < local.size(); ++id) {
+      local[id] = population.intern_species(snapshot.get_species({id}));
+    }
+    const auto handles = snapshot.get_species_handles();
+    const auto vitalities = snapshot.get_vitalities();
+    const auto diets = snapshot.get_diets();
+    population.reserve_additional(snapshot.size());
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+      if (handles[i].id >= local.size()) {
+        throw invalid_argument("Corrupted migrants");
+      }
+      grid_position position;
+      std::memcpy(&position,
+                  message.data() + positions_offset + i * sizeof(position),
+                  sizeof(position));
+      population.add(local[handles[i].id], diets[i], vitalities[i]);
+      grid.add(position);
+    }
+    return snapshot.size();
+  }
+
+ public:
+  // Shard transport.rank() siatki columns x rows komórek o boku cell_size.
+  // Każdy pas musi mieć co najmniej dwa wiersze.
+  Shard(transport_t &transport, float cell_size, uint32_t columns,
+        uint32_t rows)
+      : transport(transport), grid(cell_size, columns, rows) {
+    if (transport.size() == 0 || rows / transport.size() < 2) {
+      throw invalid_argument("Too many shards for the grid");
+    }
+  }
+
+  const Population<species_t, policy_t> &get_population() const {
+    return population;
+  }
+
+  Population<species_t, policy_t> &get_population() {
+    return population;
+  }
+
+  const SpatialGrid &get_grid() const {
+    return grid;
+  }
+
+  // Czy organizm w położeniu position należy do tego shardu w rundzie round.
+  bool owns(grid_position position, uint64_t round) const {
+    return shard_of_row(grid.cell_at(position).second, transport.size(),
+                        grid.get_rows(), round) == transport.rank();
+  }
+
+  // Organizm dodany do tego shardu; jeśli należy do innego, przejdzie tam
+  // przy najbliższej wymianie.
+  population_index_t add(species_t const &species, Diet diet,
+                         typename policy_t::value_type vitality,
+                         grid_position position) {
+    grid.add(position);
+    return population.add(species, diet, vitality);
+  }
+
+  // Wymiana przed rundą round: organizmy spoza pasa tego shardu są wysyłane
+  // do właścicieli (martwe po prostu znikają), a od pozostałych shardów
+  // przychodzą organizmy z ich pasów, które teraz należą do tego. Woła ją
+  // naraz każdy shard. Zwraca liczbę przybyłych.
+  size_t exchange(uint64_t round) {
+    const size_t ranks = transport.size();
+    const size_t own = transport.rank();
+    vector<Population<species_t, policy_t>> migrants(ranks);
+    vector<vector<grid_position>> positions(ranks);
+    vector<population_index_t> leaving;
+    for (population_index_t index = 0; index < population.size(); ++index) {
+      const size_t destination = owner(index, round);
+      if (destination == own && !population.is_dead(index)) {
+        continue;
+      }
+      leaving.push_back(index);
+      if (destination != own && !population.is_dead(index)) {
+        migrants[destination].add(population.get_species(index),
+                                  population.get_diet(index),
+                                  population.get_vitality(index));
+        positions[destination].push_back(grid.get_position(index));
+      }
+    }
+    for (size_t rank = 0; rank < ranks; ++rank) {
+      if (rank != own) {
+        transport.send(rank, pack_migrants(migrants[rank],
+                                           std::span(positions[rank])));
+      }
+    }
+    grid.apply_remap(population.remove(leaving));
+
+    size_t arrived = 0;
+    for (size_t rank = 0; rank < ranks; ++rank) {
+      if (rank != own) {
+        const std::vector<std::byte> message = transport.receive(rank);
+        arrived += unpack_migrants(message);
+      }
+    }
+    return arrived;
+  }
+
+  // Wymiana i runda spotkań sąsiadów wewnątrz shardu. Zwraca liczbę dzieci
+  // urodzonych w tym shardzie.
+  size_t simulate_round(const CounterRng &rng, uint64_t round,
+                        ThreadPool &pool) {
+    exchange(round);
+    return simulate_spatial_round(population, grid, rng, round, pool, births);
+  }
+};
+
+#endif  // JNP1_SHARDING_H
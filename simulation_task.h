@@ -0,0 +1,298 @@
+#ifndef JNP1_SIMULATION_TASK_H
+#define JNP1_SIMULATION_TASK_H
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "birth_arena.h"
+#include "counter_rng.h"
+#include "organism.h"
+#include "population.h"
+#include "scheduler.h"
+
+// Symulacja liczona kawałkami w wątku wołającego, np. w pętli zdarzeń obok
+// obsługi zapytań. Zadanie wykonuje mniej więcej step jednostek pracy
+// (spotkań, a przy kojarzeniu w pary organizmów), po czym oddaje sterowanie;
+// resume liczy kolejny kawałek. Między kawałkami nikt inny nie może zmieniać
+// populacji, a dane przekazane przez referencję albo span muszą istnieć do
+// końca zadania.
+
+// Wartość co_yield w zadaniach: koniec kawałka.
+struct simulation_pause {};
+
+template <typename result_t>
+class SimulationTask {
+ public:
+  struct promise_type {
+    std::optional<result_t> result;
+    std::exception_ptr error;
+
+    SimulationTask get_return_object() {
+      return SimulationTask(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    // Nic się nie liczy, zanim ktoś nie zawoła resume.
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_always final_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_always yield_value(simulation_pause) noexcept {
+      return {};
+    }
+
+    void return_value(result_t value) {
+      result.emplace(std::move(value));
+    }
+
+    void unhandled_exception() noexcept {
+      error = std::current_exception();
+    }
+  };
+
+ private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit SimulationTask(std::coroutine_handle<promise_type> handle)
+      : handle(handle) {
+  }
+
+ public:
+  SimulationTask(SimulationTask &&other) noexcept
+      : handle(std::exchange(other.handle, nullptr)) {
+  }
+
+  SimulationTask &operator=(SimulationTask &&other) noexcept {
+    if (this != &other) {
+      if (handle) {
+        handle.destroy();
+      }
+      handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+
+  ~SimulationTask() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  // Zadanie, z którego przeniesiono korutynę, jest skończone, ale nie ma
+  // wyniku.
+  bool done() const {
+    return !handle || handle.done();
+  }
+
+  // Liczy kolejny kawałek; zwraca, czy zostało coś do zrobienia. Wyjątek
+  // z zadania jest rzucany tutaj i kończy zadanie.
+  bool resume() {
+    if (!handle) {
+      return false;
+    }
+    if (!handle.done()) {
+      handle.resume();
+      if (handle.promise().error) {
+        std::rethrow_exception(std::exchange(handle.promise().error, nullptr));
+      }
+    }
+    return !handle.done();
+  }
+
+  // Wynik skończonego zadania.
+  result_t &get() {
+    if (!handle) {
+      throw logic_error("Simulation task was moved from");
+    }
+    if (!handle.done() || !handle.promise().result) {
+      throw logic_error("Simulation task has not finished");
+    }
+    return *handle.promise().result;
+  }
+
+  // Liczy wszystko naraz.
+  result_t run() {
+    while (resume()) {
+    }
+    return std::move(get());
+  }
+};
+
+// Odlicza jednostki pracy do końca kawałka.
+class work_budget {
+  size_t step;
+  size_t left;
+
+ public:
+  explicit work_budget(size_t step) : step(step), left(step) {
+    if (step == 0) {
+      throw invalid_argument("Step must be positive");
+    }
+  }
+
+  // Czy po units kolejnych jednostkach trzeba oddać sterowanie.
+  bool spend(size_t units = 1) {
+    if (units < left) {
+      left -= units;
+      return false;
+    }
+    left = step;
+    return true;
+  }
+};
+
+// Skojarzenie takie jak random_matching(population, rng, round, pool),
+// liczone kawałkami: klucze i sortowanie fragmentów po step organizmów,
+// scalanie po step organizmów i łączenie w pary.
+template <typename species_t, typename policy_t>
+SimulationTask<vector<encounter_pair_t>> random_matching_steps(
+    const Population<species_t, policy_t> &population, const CounterRng &rng,
+    uint64_t round, size_t step) {
+  using keyed_index_t = std::pair<uint64_t, population_index_t>;
+  work_budget budget(step);
+  vector<vector<keyed_index_t>> runs;
+  for (size_t begin = 0; begin < population.size(); begin += step) {
+    const size_t end = std::min(population.size(), begin + step);
+    vector<keyed_index_t> &run = runs.emplace_back();
+    for (size_t index = begin; index < end; ++index) {
+      if (!population.is_dead(index)) {
+        run.emplace_back(rng(round, index), index);
+      }
+    }
+    std::sort(run.begin(), run.end());
+    if (budget.spend(end - begin)) {
+      co_yield simulation_pause{};
+    }
+  }
+
+  while (runs.size() > 1) {
+    vector<vector<keyed_index_t>> merged((runs.size() + 1) / 2);
+    for (size_t task = 0; task < merged.size(); ++task) {
+      if (2 * task + 1 == runs.size()) {
+        merged[task] = std::move(runs[2 * task]);
+        continue;
+      }
+      const auto &left = runs[2 * task];
+      const auto &right = runs[2 * task + 1];
+      vector<keyed_index_t> &out = merged[task];
+      out.reserve(left.size() + right.size());
+      size_t i = 0;
+      size_t j = 0;
+      while (i < left.size() || j < right.size()) {
+        if (j == right.size() || (i < left.size() && left[i] < right[j])) {
+          out.push_back(left[i++]);
+        } else {
+          out.push_back(right[j++]);
+        }
+        if (budget.spend()) {
+          co_yield simulation_pause{};
+        }
+      }
+    }
+    runs = std::move(merged);
+  }
+
+  vector<encounter_pair_t> pairs;
+  if (runs.empty()) {
+    co_return pairs;
+  }
+  const vector<keyed_index_t> &order = runs[0];
+  pairs.reserve(order.size() / 2);
+  for (size_t i = 0; i + 1 < order.size(); i += 2) {
+    const population_index_t index1 = order[i].second;
+    const population_index_t index2 = order[i + 1].second;
+    if (!diet_is_plant(population.get_diet(index1)) ||
+        !diet_is_plant(population.get_diet(index2))) {
+      pairs.emplace_back(index1, index2);
+    }
+    if (budget.spend(2)) {
+      co_yield simulation_pause{};
+    }
+  }
+  co_return pairs;
+}
+
+// Runda jak encounter_round, po step spotkań na kawałek: dzieci są
+// dopisywane po ostatnim spotkaniu, w kolejności par i do carrying_capacity.
+// observe(index1, index2, outcome) dostaje skutek każdego spotkania. Zwraca
+// liczbę dopisanych dzieci.
+template <typename species_t, typename policy_t,
+          typename observer_t = no_encounter_observer>
+SimulationTask<size_t> encounter_round_steps(
+    Population<species_t, policy_t> &population,
+    span<const encounter_pair_t> pairs, size_t step, observer_t observe = {}) {
+  work_budget budget(step);
+  BirthArena births;
+  birth_record child;
+  size_t deaths = 0;
+  for (const auto &[index1, index2] : pairs) {
+    if (encounter_rules(population, index1, index2, child, deaths, observe)) {
+      births.push(child);
+    }
+    if (budget.spend()) {
+      population.record_deaths(std::exchange(deaths, 0));
+      co_yield simulation_pause{};
+    }
+  }
+  population.record_deaths(deaths);
+  co_return population.add_births(births);
+}
+
+// Kolejne rundy first_round, first_round + 1, ... jak simulate_round
+// z generatorem licznikowym. Zwraca liczbę dopisanych dzieci ze wszystkich
+// rund.
+template <typename species_t, typename policy_t>
+SimulationTask<size_t> simulate_rounds_steps(
+    Population<species_t, policy_t> &population, const CounterRng &rng,
+    uint64_t first_round, size_t rounds, size_t step) {
+  size_t born = 0;
+  for (uint64_t round = first_round; round < first_round + rounds; ++round) {
+    auto matching = random_matching_steps(population, rng, round, step);
+    while (matching.resume()) {
+      co_yield simulation_pause{};
+    }
+    const vector<encounter_pair_t> pairs = std::move(matching.get());
+    auto encounters = encounter_round_steps(population, span(pairs), step);
+    while (encounters.resume()) {
+      co_yield simulation_pause{};
+    }
+    born += encounters.get();
+  }
+  co_return born;
+}
+
+// Seria jak encounter_series_counted, po step spotkań na kawałek.
+template <typename species_t, typename policy_t>
+SimulationTask<series_result<typename policy_t::value_type>>
+encounter_series_steps(const Population<species_t, policy_t> &population,
+                       population_index_t hunter,
+                       span<const population_index_t> prey, size_t step) {
+  work_budget budget(step);
+  series_result<typename policy_t::value_type> result{
+      population.get_vitality(hunter), 0};
+  while (result.encounters < prey.size() && result.hunter != 0) {
+    const auto part = prey.subspan(
+        result.encounters, std::min(step, prey.size() - result.encounters));
+    const auto partial =
+        encounter_series_counted(population, hunter, result.hunter, part);
+    result = {partial.hunter, result.encounters + partial.encounters};
+    if (budget.spend(partial.encounters)) {
+      co_yield simulation_pause{};
+    }
+  }
+  co_return result;
+}
+
+#endif  // JNP1_SIMULATION_TASK_H
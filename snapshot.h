@@ -0,0 +1,427 @@
+#ifndef JNP1_SNAPSHOT_H
+#define JNP1_SNAPSHOT_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "organism.h"
+#include "population.h"
+#include "species_registry.h"
+
+// Zrzut populacji do pliku binarnego i odczyt przez mmap.
+//
+// Plik to nagłówek snapshot_header, a po nim sekcje, każda od granicy
+// snapshot_alignment bajtów: tabela gatunków (dla napisów: count + 1
+// przesunięć uint64_t i sklejone znaki), numery gatunków (uint32_t), witalności
+// (value_type polityki) i preferencje żywieniowe (po bajcie). Wszystkie liczby
+// są little-endian, czyli w kolejności bajtów procesora, więc kolumny z
+// odwzorowanego pliku można czytać bezpośrednio, bez kopiowania.
+
+static_assert(std::endian::native == std::endian::little,
+              "Snapshots are little-endian");
+
+inline constexpr char snapshot_magic[8] = {'J', 'N', 'P', '1',
+                                           'P', 'O', 'P', '\0'};
+inline constexpr uint32_t snapshot_version = 1;
+inline constexpr size_t snapshot_alignment = 64;
+
+// Kawałek pamięci wyrównany do snapshot_alignment; vector takich kawałków to
+// bufor, w którym można czytać zrzut z pamięci.
+struct alignas(snapshot_alignment) snapshot_block {
+  std::byte bytes[snapshot_alignment];
+};
+
+// Gatunki, które umiemy zapisać: napisy i typy kopiowane bajt po bajcie.
+template <typename species_t>
+concept snapshot_species = std::is_same_v<species_t, std::string> ||
+                           (std::is_trivially_copyable_v<species_t> &&
+                            alignof(species_t) <= snapshot_alignment);
+
+enum class SnapshotSpeciesKind : uint8_t {
+  raw,
+  string,
+};
+
+struct snapshot_section {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint8_t vitality_bytes;
+  VitalityOverflow overflow;
+  SnapshotSpeciesKind species_kind;
+  uint8_t reserved = 0;
+  // Rozmiar jednego gatunku dla SnapshotSpeciesKind::raw.
+  uint64_t species_bytes;
+  uint64_t species_count;
+  uint64_t organism_count;
+  snapshot_section species_offsets;
+  snapshot_section species_data;
+  snapshot_section handles;
+  snapshot_section vitalities;
+  snapshot_section diets;
+};
+
+static_assert(std::is_trivially_copyable_v<snapshot_header>);
+
+template <typename species_t>
+constexpr SnapshotSpeciesKind snapshot_species_kind() {
+  return std::is_same_v<species_t, std::string> ? SnapshotSpeciesKind::string
+                                                : SnapshotSpeciesKind::raw;
+}
+
+constexpr uint64_t snapshot_align(uint64_t offset) {
+  return (offset + snapshot_alignment - 1) / snapshot_alignment *
+         snapshot_alignment;
+}
+
+// Zapisuje populację do out, sekcja po sekcji prosto z kolumn populacji, bez
+// budowania całego pliku w pamięci.
+template <snapshot_species species_t, typename policy_t>
+void write_snapshot(std::ostream &out,
+                    const Population<species_t, policy_t> &population) {
+  using vitality_type = typename policy_t::value_type;
+  const auto &registry = population.get_registry();
+
+  snapshot_header header{};
+  std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+  header.version = snapshot_version;
+  header.vitality_bytes = sizeof(vitality_type);
+  header.overflow = policy_t::overflow;
+  header.species_kind = snapshot_species_kind<species_t>();
+  header.species_bytes =
+      std::is_same_v<species_t, std::string> ? 0 : sizeof(species_t);
+  header.species_count = registry.size();
+  header.organism_count = population.size();
+
+  uint64_t species_data_size = 0;
+  if constexpr (std::is_same_v<species_t, std::string>) {
+    for (uint32_t id = 0; id < registry.size(); ++id) {
+      species_data_size += registry.get({id}).size();
+    }
+    header.species_offsets.size = (registry.size() + 1) * sizeof(uint64_t);
+  } else {
+    species_data_size = registry.size() * sizeof(species_t);
+  }
+  header.species_data.size = species_data_size;
+  header.handles.size = population.size() * sizeof(species_handle);
+  header.vitalities.size = population.size() * sizeof(vitality_type);
+  header.diets.size = population.size() * sizeof(Diet);
+
+  uint64_t end = sizeof(snapshot_header);
+  for (snapshot_section *section :
+       {&header.species_offsets, &header.species_data, &header.handles,
+        &header.vitalities, &header.diets}) {
+    section->offset = snapshot_align(end);
+    end = section->offset + section->size;
+  }
+
+  uint64_t written = 0;
+  auto write = [&](const void *data, uint64_t size) {
+    out.write(static_cast<const char *>(data),
+              static_cast<std::streamsize>(size));
+    written += size;
+  };
+  auto start_section = [&](const snapshot_section &section) {
+    static constexpr char padding[snapshot_alignment] = {};
+    write(padding, section.offset - written);
+  };
+  write(&header, sizeof(header));
+  if constexpr (std::is_same_v<species_t, std::string>) {
+    start_section(header.species_offsets);
+    uint64_t position = 0;
+    write(&position, sizeof(position));
+    for (uint32_t id = 0; id < registry.size(); ++id) {
+      position += registry.get({id}).size();
+      write(&position, sizeof(position));
+    }
+    start_section(header.species_data);
+    for (uint32_t id = 0; id < registry.size(); ++id) {
+      const std::string &name = registry.get({id});
+      write(name.data(), name.size());
+    }
+  } else {
+    start_section(header.species_data);
+    for (uint32_t id = 0; id < registry.size(); ++id) {
+      write(&registry.get({id}), sizeof(species_t));
+    }
+  }
+  start_section(header.handles);
+  write(population.get_species_handles().data(), header.handles.size);
+  start_section(header.vitalities);
+  write(population.get_vitalities().data(), header.vitalities.size);
+  start_section(header.diets);
+  write(population.get_diets().data(), header.diets.size);
+  if (!out) {
+    throw std::ios_base::failure("Cannot write snapshot");
+  }
+}
+
+template <snapshot_species species_t, typename policy_t>
+void save_snapshot(const std::string &path,
+                   const Population<species_t, policy_t> &population) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::ios_base::failure("Cannot open " + path);
+  }
+  write_snapshot(out, population);
+  out.close();
+  if (!out) {
+    throw std::ios_base::failure("Cannot write " + path);
+  }
+}
+
+// Plik odwzorowany w pamięci tylko do odczytu.
+class MappedFile {
+  const std::byte *data = nullptr;
+  size_t length = 0;
+
+ public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+      const int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    length = static_cast<size_t>(status.st_size);
+    if (length > 0) {
+      void *mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+      }
+      data = static_cast<const std::byte *>(mapped);
+    }
+    ::close(fd);
+  }
+
+  MappedFile(MappedFile &&other) noexcept
+      : data(std::exchange(other.data, nullptr)),
+        length(std::exchange(other.length, 0)) {
+  }
+
+  MappedFile &operator=(MappedFile &&other) noexcept {
+    std::swap(data, other.data);
+    std::swap(length, other.length);
+    return *this;
+  }
+
+  ~MappedFile() {
+    if (data != nullptr) {
+      ::munmap(const_cast<std::byte *>(data), length);
+    }
+  }
+
+  std::span<const std::byte> bytes() const {
+    return {data, length};
+  }
+};
+
+// Zrzut populacji odwzorowany w pamięci. Kolumny są widokami na plik, więc
+// otwarcie kosztuje tyle, co sprawdzenie nagłówka, a strony są wczytywane
+// dopiero przy pierwszym odczycie. Typ gatunku i polityka muszą się zgadzać
+// z zapisanymi; inaczej konstruktor rzuca invalid_argument.
+template <snapshot_species species_t, vitality_policy policy_t =
+                                          wrapping_vitality>
+class PopulationSnapshot {
+ public:
+  using vitality_type = typename policy_t::value_type;
+
+ private:
+  MappedFile file;
+  std::span<const std::byte> bytes;
+  snapshot_header header{};
+
+  template <typename T>
+  std::span<const T> section(const snapshot_section &where) const {
+    return {reinterpret_cast<const T *>(bytes.data() + where.offset),
+            where.size / sizeof(T)};
+  }
+
+  void check_section(const snapshot_section &where, uint64_t count,
+                     uint64_t item_size) const {
+    if (where.offset % snapshot_alignment != 0 ||
+        where.size != count * item_size ||
+        where.offset > bytes.size() ||
+        where.size > bytes.size() - where.offset) {
+      throw invalid_argument("Corrupted snapshot");
+    }
+  }
+
+  void validate() {
+    if (bytes.size() < sizeof(snapshot_header)) {
+      throw invalid_argument("Not a population snapshot");
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) !=
+        0) {
+      throw invalid_argument("Not a population snapshot");
+    }
+    if (header.version != snapshot_version) {
+      throw invalid_argument("Unsupported snapshot version");
+    }
+    if (header.vitality_bytes != sizeof(vitality_type) ||
+        header.overflow != policy_t::overflow ||
+        header.species_kind != snapshot_species_kind<species_t>() ||
+        (header.species_kind == SnapshotSpeciesKind::raw &&
+         header.species_bytes != sizeof(species_t))) {
+      throw invalid_argument("Snapshot type mismatch");
+    }
+    if (header.species_count > UINT32_MAX ||
+        header.organism_count > UINT32_MAX) {
+      throw invalid_argument("Corrupted snapshot");
+    }
+    if constexpr (std::is_same_v<species_t, std::string>) {
+      check_section(header.species_offsets, header.species_count + 1,
+                    sizeof(uint64_t));
+      check_section(header.species_data, header.species_data.size, 1);
+      const auto offsets = section<uint64_t>(header.species_offsets);
+      for (size_t id = 0; id < header.species_count; ++id) {
+        if (offsets[id] > offsets[id + 1]) {
+          throw invalid_argument("Corrupted snapshot");
+        }
+      }
+      if (offsets[0] != 0 ||
+          offsets[header.species_count] != header.species_data.size) {
+        throw invalid_argument("Corrupted snapshot");
+      }
+    } else {
+      check_section(header.species_data, header.species_count,
+                    sizeof(species_t));
+    }
+    check_section(header.handles, header.organism_count,
+                  sizeof(species_handle));
+    check_section(header.vitalities, header.organism_count,
+                  sizeof(vitality_type));
+    check_section(header.diets, header.organism_count, sizeof(Diet));
+    // Polityka węższa niż jej typ (np. 48-bitowe packed_vitality) może
+    // dostać zrzut zapisany szerszą polityką tego samego typu.
+    if constexpr (vitality_max<policy_t>() <
+                  std::numeric_limits<vitality_type>::max()) {
+      const auto vitalities = section<vitality_type>(header.vitalities);
+      if (std::any_of(vitalities.begin(), vitalities.end(),
+                      [](vitality_type vitality) {
+                        return vitality > vitality_max<policy_t>();
+                      })) {
+        throw invalid_argument("Corrupted snapshot");
+      }
+    }
+  }
+
+ public:
+  explicit PopulationSnapshot(const std::string &path) : file(path) {
+    bytes = file.bytes();
+    validate();
+  }
+
+  // Zrzut w pamięci, np. odebrany przez sieć; data musi żyć tak długo jak
+  // zrzut i być wyrównane do snapshot_alignment (i do alignof(species_t)),
+  // bo od takich granic zaczynają się sekcje, np. w buforze z snapshot_block.
+  explicit PopulationSnapshot(std::span<const std::byte> data) : bytes(data) {
+    if (reinterpret_cast<uintptr_t>(data.data()) %
+            std::max(alignof(species_t), snapshot_alignment) !=
+        0) {
+      throw invalid_argument("Misaligned snapshot");
+    }
+    validate();
+  }
+
+  // Liczba bajtów zrzutu, od nagłówka do końca ostatniej sekcji.
+  size_t byte_size() const {
+    return header.diets.offset + header.diets.size;
+  }
+
+  size_t size() const {
+    return header.organism_count;
+  }
+
+  size_t species_count() const {
+    return header.species_count;
+  }
+
+  species_t get_species(species_handle handle) const {
+    if (handle.id >= header.species_count) {
+      throw out_of_range("Unknown species handle");
+    }
+    if constexpr (std::is_same_v<species_t, std::string>) {
+      const auto offsets = section<uint64_t>(header.species_offsets);
+      const auto data = section<char>(header.species_data);
+      return std::string(data.data() + offsets[handle.id],
+                         offsets[handle.id + 1] - offsets[handle.id]);
+    } else {
+      return section<species_t>(header.species_data)[handle.id];
+    }
+  }
+
+  std::span<const species_handle> get_species_handles() const {
+    return section<species_handle>(header.handles);
+  }
+
+  std::span<const vitality_type> get_vitalities() const {
+    return section<vitality_type>(header.vitalities);
+  }
+
+  std::span<const Diet> get_diets() const {
+    return section<Diet>(header.diets);
+  }
+
+  // Populacja do dalszej symulacji: gatunki trafiają do rejestru w zapisanej
+  // kolejności, więc numery gatunków z pliku pozostają ważne, a kolumny są
+  // kopiowane w całości.
+  Population<species_t, policy_t> load() const {
+    Population<species_t, policy_t> population;
+    for (uint32_t id = 0; id < species_count(); ++id) {
+      population.intern_species(get_species({id}));
+    }
+    const auto handles = get_species_handles();
+    const auto diets = get_diets();
+    const bool bad_handle = std::any_of(
+        handles.begin(), handles.end(),
+        [&](species_handle handle) { return handle.id >= species_count(); });
+    const bool bad_diet =
+        std::any_of(diets.begin(), diets.end(), [](Diet diet) {
+          return static_cast<uint8_t>(diet) > 0b11;
+        });
+    if (bad_handle || bad_diet) {
+      throw invalid_argument("Corrupted snapshot");
+    }
+    population.append(handles, get_vitalities(), diets);
+    return population;
+  }
+};
+
+template <snapshot_species species_t, typename policy_t = wrapping_vitality>
+Population<species_t, policy_t> load_snapshot(const std::string &path) {
+  return PopulationSnapshot<species_t, policy_t>(path).load();
+}
+
+#endif  // JNP1_SNAPSHOT_H
@@ -0,0 +1,281 @@
+#ifndef JNP1_SPATIAL_GRID_H
+#define JNP1_SPATIAL_GRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "birth_arena.h"
+#include "counter_rng.h"
+#include "population.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+
+struct grid_position {
+  float x;
+  float y;
+};
+
+// Numer komórki (x, y) na krzywej Mortona: bity x i y na przemian. Komórki
+// bliskie na płaszczyźnie mają zwykle bliskie numery, więc organizmy
+// posortowane po numerach komórek leżą w pamięci obok swoich sąsiadów.
+constexpr uint32_t morton_code(uint32_t x, uint32_t y) {
+  auto spread = [](uint32_t v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+// Położenia organizmów populacji na prostokątnej siatce columns x rows komórek
+// o boku cell_size. Organizm o numerze i w populacji ma położenie i w siatce,
+// więc po zmianach numeracji (compact, reorder) trzeba wywołać apply_remap.
+// Położenia poza siatką należą do najbliższej komórki brzegowej.
+class SpatialGrid {
+  static constexpr uint32_t max_cells = 1 << 16;
+
+  float cell_size;
+  uint32_t columns;
+  uint32_t rows;
+  vector<grid_position> positions;
+
+  static uint32_t clamp_cell(float coordinate, uint32_t cells) {
+    const float cell = std::floor(coordinate);
+    if (!(cell >= 0)) {
+      return 0;
+    }
+    return cell >= cells ? cells - 1 : static_cast<uint32_t>(cell);
+  }
+
+ public:
+  SpatialGrid(float cell_size, uint32_t columns, uint32_t rows)
+      : cell_size(cell_size), columns(columns), rows(rows) {
+    if (!(cell_size > 0) || columns == 0 || rows == 0 ||
+        columns > max_cells || rows > max_cells) {
+      throw invalid_argument("Invalid grid dimensions");
+    }
+  }
+
+  size_t size() const {
+    return positions.size();
+  }
+
+  uint32_t get_columns() const {
+    return columns;
+  }
+
+  uint32_t get_rows() const {
+    return rows;
+  }
+
+  population_index_t add(grid_position position) {
+    positions.push_back(position);
+    return static_cast<population_index_t>(positions.size() - 1);
+  }
+
+  grid_position get_position(population_index_t index) const {
+    return positions[index];
+  }
+
+  void set_position(population_index_t index, grid_position position) {
+    positions[index] = position;
+  }
+
+  std::pair<uint32_t, uint32_t> cell_at(grid_position position) const {
+    return {clamp_cell(position.x / cell_size, columns),
+            clamp_cell(position.y / cell_size, rows)};
+  }
+
+  std::pair<uint32_t, uint32_t> cell_of(population_index_t index) const {
+    return cell_at(positions[index]);
+  }
+
+  uint32_t cell_code(population_index_t index) const {
+    const auto [x, y] = cell_of(index);
+    return morton_code(x, y);
+  }
+
+  // Czy organizmy są w tej samej albo w sąsiednich (także po skosie)
+  // komórkach.
+  bool are_neighbours(population_index_t index1,
+                      population_index_t index2) const {
+    const auto [x1, y1] = cell_of(index1);
+    const auto [x2, y2] = cell_of(index2);
+    return std::max(x1, x2) - std::min(x1, x2) <= 1 &&
+           std::max(y1, y2) - std::min(y1, y2) <= 1;
+  }
+
+  // Numery organizmów posortowane po komórkach w kolejności Mortona,
+  // a w obrębie komórki rosnąco.
+  vector<population_index_t> morton_order() const {
+    vector<std::pair<uint32_t, population_index_t>> keyed(size());
+    for (population_index_t index = 0; index < size(); ++index) {
+      keyed[index] = {cell_code(index), index};
+    }
+    std::sort(keyed.begin(), keyed.end());
+    vector<population_index_t> order(size());
+    for (size_t i = 0; i < size(); ++i) {
+      order[i] = keyed[i].second;
+    }
+    return order;
+  }
+
+  // Przenumerowanie jak w populacji; remap[i] to nowy numer organizmu i albo
+  // Population<...>::removed (UINT32_MAX) dla usuniętych.
+  void apply_remap(span<const population_index_t> remap) {
+    if (remap.size() != size()) {
+      throw invalid_argument("Remap does not match the grid");
+    }
+    const auto kept = static_cast<size_t>(std::count_if(
+        remap.begin(), remap.end(), [](population_index_t new_index) {
+          return new_index != UINT32_MAX;
+        }));
+    vector<grid_position> moved(kept);
+    for (population_index_t index = 0; index < size(); ++index) {
+      if (remap[index] != UINT32_MAX) {
+        moved[remap[index]] = positions[index];
+      }
+    }
+    positions = std::move(moved);
+  }
+};
+
+// Układa organizmy populacji i ich położenia w kolejności komórek, żeby
+// spotkania sąsiadów czytały pobliskie fragmenty kolumn. Zwraca nowe numery
+// dawnych organizmów.
+template <typename species_t, typename policy_t>
+vector<population_index_t> sort_by_cells(
+    Population<species_t, policy_t> &population, SpatialGrid &grid) {
+  if (grid.size() != population.size()) {
+    throw invalid_argument("Grid does not match the population");
+  }
+  const auto order = grid.morton_order();
+  const auto remap = population.reorder(order);
+  grid.apply_remap(remap);
+  return remap;
+}
+
+// Skojarzenie żywych organizmów w pary leżące w tej samej albo w sąsiednich
+// komórkach. W obrębie komórki kolejność jest losowana kluczami rng(round,
+// index), jak w random_matching, i pary tworzą kolejne organizmy. Organizm,
+// który został bez pary w swojej komórce, czeka na taki sam organizm z
+// sąsiedniej komórki. Pary dwóch roślin są pomijane.
+template <typename species_t, typename policy_t>
+vector<encounter_pair_t> spatial_matching(
+    const Population<species_t, policy_t> &population, const SpatialGrid &grid,
+    const CounterRng &rng, uint64_t round) {
+  if (grid.size() != population.size()) {
+    throw invalid_argument("Grid does not match the population");
+  }
+  vector<std::tuple<uint32_t, uint64_t, population_index_t>> keyed;
+  keyed.reserve(population.size());
+  for (population_index_t index = 0; index < population.size(); ++index) {
+    if (!population.is_dead(index)) {
+      keyed.emplace_back(grid.cell_code(index), rng(round, index), index);
+    }
+  }
+  std::sort(keyed.begin(), keyed.end());
+
+  auto can_meet = [&](population_index_t index1, population_index_t index2) {
+    return !diet_is_plant(population.get_diet(index1)) ||
+           !diet_is_plant(population.get_diet(index2));
+  };
+  vector<encounter_pair_t> pairs;
+  pairs.reserve(keyed.size() / 2);
+  std::unordered_map<uint32_t, population_index_t> waiting;
+  for (size_t begin = 0; begin < keyed.size();) {
+    const uint32_t code = std::get<0>(keyed[begin]);
+    size_t end = begin;
+    while (end < keyed.size() && std::get<0>(keyed[end]) == code) {
+      ++end;
+    }
+    for (; begin + 1 < end; begin += 2) {
+      const population_index_t index1 = std::get<2>(keyed[begin]);
+      const population_index_t index2 = std::get<2>(keyed[begin + 1]);
+      if (can_meet(index1, index2)) {
+        pairs.emplace_back(index1, index2);
+      }
+    }
+    if (begin == end) {
+      continue;
+    }
+
+    const population_index_t lonely = std::get<2>(keyed[begin]);
+    const auto [x, y] = grid.cell_of(lonely);
+    bool matched = false;
+    for (int dy = -1; dy <= 1 && !matched; ++dy) {
+      for (int dx = -1; dx <= 1 && !matched; ++dx) {
+        const int64_t nx = int64_t{x} + dx;
+        const int64_t ny = int64_t{y} + dy;
+        if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 ||
+            nx >= grid.get_columns() || ny >= grid.get_rows()) {
+          continue;
+        }
+        const auto other = waiting.find(morton_code(nx, ny));
+        if (other != waiting.end() && can_meet(other->second, lonely)) {
+          pairs.emplace_back(other->second, lonely);
+          waiting.erase(other);
+          matched = true;
+        }
+      }
+    }
+    if (!matched) {
+      waiting.emplace(code, lonely);
+    }
+    begin = end;
+  }
+  return pairs;
+}
+
+// Runda spotkań sąsiadów. Dzieci dostają położenie pierwszego organizmu
+// z pary. Obserwator rundy zaznacza pierwsze organizmy par, które mają
+// dziecko; pary są rozłączne, więc każdy znacznik zapisuje jeden wątek,
+// a rodziców w kolejności par daje potem przejście po parach. Zwraca liczbę
+// urodzonych.
+template <typename species_t, typename policy_t>
+size_t simulate_spatial_round(Population<species_t, policy_t> &population,
+                              SpatialGrid &grid, const CounterRng &rng,
+                              uint64_t round, ThreadPool &pool,
+                              RoundBirths &births) {
+  const auto pairs = spatial_matching(population, grid, rng, round);
+  vector<uint8_t> has_child(population.size());
+  const size_t born = encounter_round(
+      population, span(pairs), pool, births,
+      [&has_child](size_t, population_index_t index1, population_index_t,
+                   const auto &outcome) {
+        has_child[index1] = outcome.has_child;
+      });
+  vector<population_index_t> parents;
+  for (const auto &[index1, index2] : pairs) {
+    if (has_child[index1]) {
+      parents.push_back(index1);
+    }
+  }
+  // Dzieci ponad carrying_capacity odpadają od końca.
+  parents.resize(born);
+  for (const population_index_t parent : parents) {
+    grid.add(grid.get_position(parent));
+  }
+  return born;
+}
+
+template <typename species_t, typename policy_t>
+size_t simulate_spatial_round(Population<species_t, policy_t> &population,
+                              SpatialGrid &grid, const CounterRng &rng,
+                              uint64_t round, ThreadPool &pool) {
+  RoundBirths births(pool.size());
+  return simulate_spatial_round(population, grid, rng, round, pool, births);
+}
+
+#endif  // JNP1_SPATIAL_GRID_H
@@ -0,0 +1,98 @@
+#ifndef JNP1_SPECIES_REGISTRY_H
+#define JNP1_SPECIES_REGISTRY_H
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "organism.h"
+
+namespace {
+using std::vector, std::unordered_map, std::out_of_range;
+}  // namespace
+
+// Numer gatunku w rejestrze. Porównanie, hashowanie i kopiowanie to operacje
+// na jednej liczbie, a Organism<species_handle, ...> zajmuje 16 bajtów
+// niezależnie od tego, jak duży jest oryginalny gatunek.
+struct species_handle {
+  uint32_t id;
+
+  constexpr bool operator==(const species_handle &) const = default;
+};
+
+template <>
+struct std::hash<species_handle> {
+  constexpr size_t operator()(species_handle handle) const noexcept {
+    return handle.id;
+  }
+};
+
+template <typename T>
+concept hashable = requires(const T &value) {
+  { std::hash<T>{}(value) } -> std::convertible_to<size_t>;
+};
+
+// Rejestr, w którym każdy gatunek jest zapisany raz i dostaje kolejny numer.
+// Gatunki bez std::hash są wyszukiwane liniowo.
+template <typename species_t>
+requires equality_comparable<species_t> class SpeciesRegistry {
+  struct no_index {};
+
+  vector<species_t> species;
+  [[no_unique_address]] std::conditional_t<
+      hashable<species_t>, unordered_map<species_t, uint32_t>, no_index>
+      index;
+
+ public:
+  size_t size() const {
+    return species.size();
+  }
+
+  species_handle intern(species_t const &new_species) {
+    if constexpr (hashable<species_t>) {
+      auto [it, inserted] = index.try_emplace(
+          new_species, static_cast<uint32_t>(species.size()));
+      if (inserted) {
+        species.push_back(new_species);
+      }
+      return {it->second};
+    } else {
+      for (uint32_t id = 0; id < species.size(); ++id) {
+        if (species[id] == new_species) {
+          return {id};
+        }
+      }
+      species.push_back(new_species);
+      return {static_cast<uint32_t>(species.size() - 1)};
+    }
+  }
+
+  const species_t &get(species_handle handle) const {
+    if (handle.id >= species.size()) {
+      throw out_of_range("Unknown species handle");
+    }
+    return species[handle.id];
+  }
+
+  // Zamiana organizmu na organizm o gatunku z rejestru i z powrotem.
+  template <bool can_eat_meat, bool can_eat_plants, typename policy_t>
+  Organism<species_handle, can_eat_meat, can_eat_plants, policy_t> intern(
+      Organism<species_t, can_eat_meat, can_eat_plants, policy_t> const
+          &organism) {
+    return {intern(organism.get_species()), organism.get_vitality()};
+  }
+
+  template <bool can_eat_meat, bool can_eat_plants, typename policy_t>
+  Organism<species_t, can_eat_meat, can_eat_plants, policy_t> resolve(
+      Organism<species_handle, can_eat_meat, can_eat_plants, policy_t> const
+          &organism) const {
+    return {get(organism.get_species()), organism.get_vitality()};
+  }
+};
+
+#endif  // JNP1_SPECIES_REGISTRY_H
@@ -1,9 +1,36 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 
+#include "any_organism.h"
+#include "birth_arena.h"
+#include "counter_rng.h"
+#include "device_population.h"
+#include "ecosystem.h"
+#include "encounter_counters.h"
+#include "event_log.h"
 #include "organism.h"
+#include "packed_organism.h"
+#include "perf_counters.h"
+#include "population.h"
+#include "population_stats.h"
+#include "scheduler.h"
+#include "simulation_task.h"
+#include "sharding.h"
+#include "snapshot.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
 
 using namespace std;
 void org_test_0() {
@@ -1212,6 +1239,2174 @@ void org_test_107() {
   assert(!std::get<2>(enc).has_value());
 }
 
+// Porównanie encounter_in_place z szablonowym encounter dla pary typów.
+template <typename O1, typename O2>
+void check_population_matches(const O1 &o1, const O2 &o2) {
+  Population<string> population;
+  auto i1 = population.add(o1);
+  auto i2 = population.add(o2);
+  bool born = encounter_in_place(population, i1, i2);
+  auto enc = encounter(o1, o2);
+
+  assert(population.get_vitality(i1) == std::get<0>(enc).get_vitality());
+  assert(population.get_vitality(i2) == std::get<1>(enc).get_vitality());
+  assert(born == std::get<2>(enc).has_value());
+  if (born) {
+    assert(population.size() == 3);
+    assert(population.get_species(2) == std::get<2>(enc)->get_species());
+    assert(population.get_vitality(2) == std::get<2>(enc)->get_vitality());
+    assert(population.get_diet(2) == O1::diet);
+  }
+}
+
+template <typename O1, typename O2>
+void check_population_matches_all() {
+  for (string s2 : {"Dinozaur", "Tyranozaur"}) {
+    for (vitality_t v1 : {0, 40, 60}) {
+      for (vitality_t v2 : {0, 40, 60}) {
+        check_population_matches(O1{"Dinozaur", v1}, O2{s2, v2});
+      }
+    }
+  }
+}
+
+template <typename O1>
+void check_population_matches_animal() {
+  check_population_matches_all<O1, Carnivore<string>>();
+  check_population_matches_all<O1, Omnivore<string>>();
+  check_population_matches_all<O1, Herbivore<string>>();
+  check_population_matches_all<O1, Plant<string>>();
+  check_population_matches_all<Plant<string>, O1>();
+}
+
+void population_test_0() {
+  check_population_matches_animal<Carnivore<string>>();
+  check_population_matches_animal<Omnivore<string>>();
+  check_population_matches_animal<Herbivore<string>>();
+}
+
+void population_test_1() {
+  Population<string> population;
+  population.add(Carnivore<string>{"Wilk", 100});
+  population.add(Omnivore<string>{"Pies", 10});
+  population.add(Herbivore<string>{"Koza", 50});
+  population.add(Plant<string>{"Sosna", 30});
+  population.add(Herbivore<string>{"Koza", 30});
+
+  vector<encounter_pair_t> pairs = {{0, 1}, {2, 3}, {2, 4}, {0, 3}};
+  size_t births = encounter_batch(population, span(pairs));
+
+  assert(births == 1);
+  assert(population.size() == 6);
+  assert(population.get_vitality(0) == 105);
+  assert(population.is_dead(1));
+  assert(population.get_vitality(2) == 80);
+  assert(population.is_dead(3));
+  assert(population.get_vitality(5) == 55);
+  assert(population.get_species(5) == "Koza");
+  assert((population.get<false, true>(5).get_vitality() == 55));
+}
+
+void population_test_2() {
+  Population<string> population;
+  population.add(Plant<string>{"Sosna", 30});
+  population.add(Plant<string>{"Sosna", 30});
+
+  bool thrown = false;
+  try {
+    encounter_in_place(population, 0, 1);
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+// Losowa populacja o małej liczbie gatunków, żeby zdarzały się gody.
+template <typename policy_t = wrapping_vitality>
+Population<string, policy_t> random_population(size_t size,
+                                               std::mt19937 &gen) {
+  Population<string, policy_t> population;
+  const string names[] = {"Dinozaur", "Tyranozaur", "Dodo"};
+  const Diet diets[] = {Diet::carnivore, Diet::omnivore, Diet::herbivore,
+                        Diet::plant};
+  for (size_t i = 0; i < size; ++i) {
+    population.add(names[gen() % 3], diets[gen() % 4], gen() % 4 * 20);
+  }
+  return population;
+}
+
+void population_test_3() {
+  std::mt19937 gen(4);
+  for (size_t round = 0; round < 100; ++round) {
+    Population<string> population = random_population(64, gen);
+    vector<encounter_pair_t> pairs;
+    for (size_t i = 0; i < 45; ++i) {
+      population_index_t i1 = gen() % 64;
+      population_index_t i2 = gen() % 64;
+      if (population.get_diet(i1) == Diet::plant &&
+          population.get_diet(i2) == Diet::plant) {
+        continue;
+      }
+      pairs.emplace_back(i1, i2);
+    }
+
+    Population<string> expected = population;
+    size_t expected_births = encounter_batch(expected, span(pairs));
+    size_t births = encounter_batch_simd(population, span(pairs));
+
+    assert(births == expected_births);
+    assert(population.size() == expected.size());
+    for (population_index_t i = 0; i < 64; ++i) {
+      assert(population.get_vitality(i) == expected.get_vitality(i));
+    }
+  }
+}
+
+void population_test_4() {
+  std::mt19937 gen(5);
+  Population<string> population = random_population(256, gen);
+  vector<population_index_t> order(256);
+  for (population_index_t i = 0; i < 256; ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), gen);
+  vector<encounter_pair_t> pairs;
+  for (size_t i = 0; i < 256; i += 2) {
+    if (population.get_diet(order[i]) != Diet::plant ||
+        population.get_diet(order[i + 1]) != Diet::plant) {
+      pairs.emplace_back(order[i], order[i + 1]);
+    }
+  }
+
+  Population<string> expected = population;
+  size_t expected_births = encounter_batch(expected, span(pairs));
+  size_t births = encounter_batch_simd(population, span(pairs));
+
+  assert(births == expected_births);
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(population.get_vitality(i) == expected.get_vitality(i));
+    assert(population.get_species(i) == expected.get_species(i));
+  }
+}
+
+// Gatunek, który liczy swoje kopie.
+struct counted_species {
+  static inline size_t copies = 0;
+  int id;
+
+  counted_species(int id) : id(id) {
+  }
+  counted_species(const counted_species &other) : id(other.id) {
+    ++copies;
+  }
+  counted_species(counted_species &&other) = default;
+  counted_species &operator=(const counted_species &other) = default;
+  counted_species &operator=(counted_species &&other) = default;
+  bool operator==(const counted_species &other) const {
+    return id == other.id;
+  }
+};
+
+void move_test_0() {
+  Carnivore<counted_species> wolf(counted_species(1), 100);
+  Omnivore<counted_species> dog(counted_species(2), 10);
+  counted_species::copies = 0;
+
+  auto [wolf_result, dog_result, child] =
+      encounter(std::move(wolf), std::move(dog));
+
+  assert(counted_species::copies == 0);
+  assert(wolf_result.get_vitality() == 105);
+  assert(dog_result.is_dead());
+  assert(!child.has_value());
+}
+
+void move_test_1() {
+  Herbivore<counted_species> goat1(counted_species(1), 40);
+  Herbivore<counted_species> goat2(counted_species(1), 60);
+  counted_species::copies = 0;
+
+  auto [goat1_result, goat2_result, child] =
+      encounter(std::move(goat1), std::move(goat2));
+
+  // Dziecko musi dostać własną kopię gatunku.
+  assert(counted_species::copies == 1);
+  assert(child->get_vitality() == 50);
+  assert(child->get_species().id == 1);
+}
+
+void move_test_2() {
+  Carnivore<counted_species> wolf(counted_species(1), 100);
+  Omnivore<counted_species> dog(counted_species(2), 10);
+  Plant<counted_species> pine(counted_species(3), 34);
+  Herbivore<counted_species> elephant(counted_species(4), 500);
+  counted_species::copies = 0;
+
+  auto wolf_result = encounter_series(std::move(wolf), std::move(dog),
+                                      std::move(pine), std::move(elephant));
+
+  assert(counted_species::copies == 0);
+  assert(wolf_result.get_vitality() == 105);
+}
+
+void move_test_3() {
+  Carnivore<string> wolf("Canis lupus", 100);
+  Omnivore<string> dog("Canis familiaris", 10);
+
+  wolf = std::get<0>(encounter(wolf, dog));
+
+  assert(wolf.get_vitality() == 105);
+  assert(wolf.get_species() == "Canis lupus");
+}
+
+void registry_test_0() {
+  SpeciesRegistry<string> registry;
+  species_handle lion = registry.intern("Panthera leo");
+  species_handle gazelle = registry.intern("Gazella dorcas");
+
+  assert(registry.intern("Panthera leo") == lion);
+  assert(!(lion == gazelle));
+  assert(registry.size() == 2);
+  assert(registry.get(gazelle) == "Gazella dorcas");
+  static_assert(sizeof(Carnivore<species_handle>) == 16);
+}
+
+void registry_test_1() {
+  SpeciesRegistry<string> registry;
+  auto lion = registry.intern(Carnivore<string>("Panthera leo", 462));
+  auto gazelle = registry.intern(Herbivore<string>("Gazella dorcas", 130));
+
+  auto [lion_result, gazelle_result, child] = encounter(lion, gazelle);
+
+  assert(lion_result.get_vitality() == 527);
+  assert(gazelle_result.is_dead());
+  assert(registry.resolve(lion_result).get_species() == "Panthera leo");
+}
+
+// Gatunek bez std::hash.
+struct unhashed_species {
+  int id;
+
+  bool operator==(const unhashed_species &other) const = default;
+};
+
+void registry_test_2() {
+  SpeciesRegistry<unhashed_species> registry;
+  species_handle a = registry.intern({1});
+  species_handle b = registry.intern({2});
+
+  assert(registry.intern({1}) == a);
+  assert(registry.get(b).id == 2);
+
+  bool thrown = false;
+  try {
+    registry.get({7});
+  } catch (const out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+void scheduler_test_0() {
+  std::mt19937 gen(6);
+  Population<string> population = random_population(10000, gen);
+  std::mt19937_64 generator(7);
+  auto pairs = random_matching(population, generator);
+
+  vector<bool> seen(population.size());
+  for (const auto &[i1, i2] : pairs) {
+    assert(!seen[i1] && !seen[i2]);
+    seen[i1] = seen[i2] = true;
+    assert(!population.is_dead(i1) && !population.is_dead(i2));
+    assert(population.get_diet(i1) != Diet::plant ||
+           population.get_diet(i2) != Diet::plant);
+  }
+}
+
+void scheduler_test_1() {
+  std::mt19937 gen(8);
+  Population<string> population = random_population(20000, gen);
+  std::mt19937_64 generator(9);
+  auto pairs = random_matching(population, generator);
+
+  Population<string> expected = population;
+  size_t expected_births = encounter_batch(expected, span(pairs));
+  for (size_t threads : {1, 3}) {
+    Population<string> result = population;
+    ThreadPool pool(threads);
+    size_t births = encounter_round(result, span(pairs), pool);
+
+    assert(births == expected_births);
+    assert(result.size() == expected.size());
+    for (population_index_t i = 0; i < result.size(); ++i) {
+      assert(result.get_vitality(i) == expected.get_vitality(i));
+      assert(result.get_species(i) == expected.get_species(i));
+    }
+  }
+}
+
+void scheduler_test_2() {
+  ThreadPool pool(4);
+  vector<size_t> hits(1000);
+  pool.parallel_for(hits.size(), [&](size_t task, size_t worker) {
+    assert(worker < pool.size());
+    ++hits[task];
+  });
+  assert(std::count(hits.begin(), hits.end(), 1) == 1000);
+
+  bool thrown = false;
+  try {
+    pool.parallel_for(10, [](size_t task, size_t) {
+      if (task == 5) {
+        throw logic_error("task");
+      }
+    });
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+// Skojarzenie z generatora licznikowego nie zależy od liczby wątków.
+void scheduler_test_3() {
+  std::mt19937 gen(19);
+  Population<string> population = random_population(30000, gen);
+  const CounterRng rng(20);
+
+  ThreadPool serial(1);
+  const auto expected = random_matching(population, rng, 0, serial);
+  vector<size_t> seen(population.size());
+  for (const auto &[index1, index2] : expected) {
+    ++seen[index1];
+    ++seen[index2];
+  }
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(seen[i] <= 1);
+    assert(!population.is_dead(i) || seen[i] == 0);
+  }
+  assert(random_matching(population, rng, 1, serial) != expected);
+  assert(random_matching(population, CounterRng(21), 0, serial) != expected);
+
+  Population<string> expected_population = population;
+  for (uint64_t round = 0; round < 5; ++round) {
+    simulate_round(expected_population, rng, round, serial);
+  }
+  for (size_t threads : {2, 5}) {
+    ThreadPool pool(threads);
+    assert(random_matching(population, rng, 0, pool) == expected);
+    Population<string> result = population;
+    RoundBirths births(pool.size());
+    for (uint64_t round = 0; round < 5; ++round) {
+      simulate_round(result, rng, round, pool, births);
+    }
+    assert(result.size() == expected_population.size());
+    for (population_index_t i = 0; i < result.size(); ++i) {
+      assert(result.get_vitality(i) == expected_population.get_vitality(i));
+    }
+  }
+}
+
+void series_test_0() {
+  Population<string> population;
+  auto wolf = population.add(Carnivore<string>("Wilk", 100));
+  auto dead_dog = population.add(Omnivore<string>("Pies", 0));
+  auto pine = population.add(Plant<string>("Sosna", 34));
+  auto dog = population.add(Omnivore<string>("Pies", 10));
+  auto elephant = population.add(Herbivore<string>("Slon", 500));
+  vector<population_index_t> prey = {dead_dog, pine, dog, elephant};
+
+  assert(encounter_series(population, wolf, span(prey)) == 105);
+  assert(population.get_vitality(wolf) == 100);
+  assert(population.get_vitality(dog) == 10);
+}
+
+void series_test_1() {
+  std::mt19937 gen(10);
+  Population<string> population = random_population(500, gen);
+  vector<population_index_t> prey;
+  vector<size_t> lengths;
+  for (size_t chain = 0; chain < 200; ++chain) {
+    lengths.push_back(chain % 7 == 0 ? 300 : gen() % 5);
+    for (size_t i = 0; i < lengths.back(); ++i) {
+      prey.push_back(gen() % 500);
+    }
+  }
+  // Bez par dwóch roślin.
+  for (auto &index : prey) {
+    while (population.get_diet(index) == Diet::plant) {
+      index = gen() % 500;
+    }
+  }
+
+  vector<encounter_chain> chains;
+  size_t offset = 0;
+  for (size_t chain = 0; chain < lengths.size(); ++chain) {
+    chains.push_back({static_cast<population_index_t>(chain),
+                      span(prey).subspan(offset, lengths[chain])});
+    offset += lengths[chain];
+  }
+
+  ThreadPool pool(4);
+  auto results = encounter_series_parallel(population, span(chains), pool);
+  for (size_t chain = 0; chain < chains.size(); ++chain) {
+    assert(results[chain] == encounter_series(population, chains[chain].hunter,
+                                              chains[chain].prey));
+  }
+}
+
+void series_test_2() {
+  Population<string> population;
+  population.add(Carnivore<string>("Wilk", 100));
+  population.add(Omnivore<string>("Pies", 10));
+  population.add(Plant<string>("Sosna", 34));
+  population.add(Herbivore<string>("Slon", 500));
+
+  // Porównanie z szablonowym encounter_series.
+  auto expected = encounter_series(population.get<true, false>(0),
+                                   population.get<true, true>(1),
+                                   population.get<false, false>(2),
+                                   population.get<false, true>(3));
+  vector<population_index_t> prey = {1, 2, 3};
+  assert(encounter_series(population, 0, span(prey)) ==
+         expected.get_vitality());
+}
+
+template <size_t... indices>
+constexpr auto long_series(std::index_sequence<indices...>) {
+  return encounter_series(Herbivore<int>(0, 1),
+                          Plant<int>(static_cast<int>(indices), 1)...);
+}
+
+void series_test_3() {
+  // Dłuższa seria niż domyślny limit głębokości constexpr.
+  static_assert(long_series(std::make_index_sequence<600>()).get_vitality() ==
+                601);
+  constexpr Carnivore<int> alone(1, 5);
+  static_assert(encounter_series(alone).get_vitality() == 5);
+  static_assert(!is_organism_of<int, int>::value);
+  static_assert(is_organism_of<Plant<int>, int>::value);
+  static_assert(!is_organism_of<Plant<long>, int>::value);
+}
+
+void series_test_4() {
+  constexpr Carnivore<int> wolf(1, 10);
+  constexpr Carnivore<int> bear(2, 50);
+  constexpr Herbivore<int> goat(3, 5);
+
+  constexpr auto all = encounter_series_counted(wolf, goat, goat);
+  static_assert(all.encounters == 2);
+  static_assert(all.hunter.get_vitality() == 10 + 2 + 2);
+
+  // Wilk ginie w walce z niedźwiedziem, a kolejnych spotkań już nie ma.
+  constexpr auto stopped =
+      encounter_series_counted(wolf, goat, bear, goat, goat);
+  static_assert(stopped.encounters == 2);
+  static_assert(stopped.hunter.is_dead());
+  static_assert(encounter_series(wolf, goat, bear, goat).is_dead());
+
+  constexpr auto dead = encounter_series_counted(wolf.kill(), goat);
+  static_assert(dead.encounters == 0);
+}
+
+void series_test_5() {
+  Population<string> population;
+  auto wolf = population.add(Carnivore<string>("Wilk", 10));
+  auto bear = population.add(Carnivore<string>("Niedzwiedz", 50));
+  auto goat = population.add(Herbivore<string>("Koza", 5));
+  vector<population_index_t> prey = {goat, bear, goat, goat};
+
+  auto result = encounter_series_counted(population, wolf, span(prey));
+  assert(result.encounters == 2);
+  assert(result.hunter == 0);
+  assert(encounter_series(population, wolf, span(prey)) == 0);
+}
+
+void outcome_test_0() {
+  constexpr Omnivore<species_handle> dog({1}, 10);
+  constexpr Carnivore<species_handle> wolf({2}, 100);
+  constexpr auto outcome = encounter_vitalities(wolf, dog);
+  static_assert(outcome.vitality1 == 105);
+  static_assert(outcome.vitality2 == 0);
+  static_assert(!outcome.has_child);
+
+  constexpr auto mating = encounter_vitalities(wolf, wolf.set_vitality(50));
+  static_assert(mating.has_child && mating.child_vitality == 75);
+  static_assert(sizeof(encounter_outcome) <= 32);
+}
+
+void outcome_test_1() {
+  Population<string> population;
+  auto goat1 = population.add(Herbivore<string>("Koza", 40));
+  auto goat2 = population.add(Herbivore<string>("Koza", 60));
+  auto pine = population.add(Plant<string>("Sosna", 30));
+
+  auto mating = encounter_outcome_at(population, goat1, goat2);
+  assert(mating.has_child && mating.child_vitality == 50);
+  assert(population.size() == 3);
+
+  birth_record child;
+  auto eating = encounter_outcome_at(population, pine, goat1);
+  assert(!apply_outcome(population, pine, goat1, eating, child));
+  assert(population.is_dead(pine));
+  assert(population.get_vitality(goat1) == 70);
+  assert(apply_outcome(population, goat1, goat2, mating, child));
+  assert(child.vitality == 50 && child.diet == Diet::herbivore);
+}
+
+void interaction_test_0() {
+  static_assert(diet_interaction(Diet::plant, Diet::plant) ==
+                Interaction::illegal);
+  static_assert(diet_interaction(Diet::carnivore, Diet::omnivore) ==
+                Interaction::mutual);
+  static_assert(diet_interaction(Diet::herbivore, Diet::carnivore) ==
+                Interaction::second_eats);
+  static_assert(diet_interaction(Diet::plant, Diet::omnivore) ==
+                Interaction::second_eats_plant);
+  static_assert(diet_interaction(Diet::herbivore, Diet::herbivore) ==
+                Interaction::inert);
+  static_assert(diet_interaction(Diet::carnivore, Diet::plant) ==
+                Interaction::inert);
+  static_assert(diet_interaction(Carnivore<int>::diet, Herbivore<int>::diet) ==
+                Interaction::first_eats);
+}
+
+// Porównanie encounter dla AnyOrganism z szablonowym encounter.
+template <typename O1, typename O2>
+void check_any_matches(const O1 &o1, const O2 &o2) {
+  auto [any1, any2, any_child] =
+      encounter(AnyOrganism<string>(o1), AnyOrganism<string>(o2));
+  auto [result1, result2, child] = encounter(o1, o2);
+
+  assert(any1.get_vitality() == result1.get_vitality());
+  assert(any2.get_vitality() == result2.get_vitality());
+  assert(any1.get_diet() == O1::diet && any2.get_diet() == O2::diet);
+  assert(any_child.has_value() == child.has_value());
+  if (child) {
+    assert(any_child->get_vitality() == child->get_vitality());
+    assert(any_child->get_species() == child->get_species());
+    assert(any_child->get_diet() == O1::diet);
+  }
+}
+
+template <typename O1, typename O2>
+void check_any_matches_all() {
+  for (string s2 : {"Dinozaur", "Tyranozaur"}) {
+    for (vitality_t v1 : {0, 40, 60}) {
+      for (vitality_t v2 : {0, 40, 60}) {
+        check_any_matches(O1{"Dinozaur", v1}, O2{s2, v2});
+      }
+    }
+  }
+}
+
+template <typename O1>
+void check_any_matches_animal() {
+  check_any_matches_all<O1, Carnivore<string>>();
+  check_any_matches_all<O1, Omnivore<string>>();
+  check_any_matches_all<O1, Herbivore<string>>();
+  check_any_matches_all<O1, Plant<string>>();
+  check_any_matches_all<Plant<string>, O1>();
+}
+
+void any_test_0() {
+  check_any_matches_animal<Carnivore<string>>();
+  check_any_matches_animal<Omnivore<string>>();
+  check_any_matches_animal<Herbivore<string>>();
+
+  bool thrown = false;
+  try {
+    encounter(AnyOrganism<string>(Plant<string>("Sosna", 1)),
+              AnyOrganism<string>(Plant<string>("Sosna", 1)));
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+void any_test_1() {
+  constexpr Carnivore<species_handle> wolf({1}, 100);
+  constexpr AnyOrganism<species_handle> prey[] = {
+      Omnivore<species_handle>({2}, 0), Plant<species_handle>({3}, 34),
+      Omnivore<species_handle>({2}, 10), Herbivore<species_handle>({4}, 500)};
+  constexpr auto result =
+      encounter_series_counted(AnyOrganism<species_handle>(wolf),
+                               span<const AnyOrganism<species_handle>>(prey));
+  static_assert(result.hunter.get_vitality() == 105);
+  static_assert(result.encounters == 4);
+  static_assert(result.hunter.as<true, false>().get_vitality() == 105);
+  static_assert(sizeof(AnyOrganism<species_handle>) == 16);
+
+  bool thrown = false;
+  try {
+    static_cast<void>(result.hunter.as<true, true>());
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+// Witalność typu i polityki z parametru, jak w Organism.
+void any_test_2() {
+  using saturating16 = basic_saturating_vitality<uint16_t>;
+  using any16 = AnyOrganism<species_handle, saturating16>;
+  static_assert(sizeof(any16) == 8);
+  static_assert(std::is_same_v<any16::vitality_type, uint16_t>);
+
+  constexpr any16 goat = Herbivore<species_handle, saturating16>({1}, 65000);
+  constexpr any16 grass = Plant<species_handle, saturating16>({2}, 1000);
+  constexpr auto meal = encounter(goat, grass);
+  static_assert(std::get<0>(meal).get_vitality() == 65535);
+  static_assert(std::get<1>(meal).is_dead());
+  static_assert(!std::get<2>(meal).has_value());
+
+  constexpr auto kids = encounter(goat, goat.set_vitality(60000));
+  static_assert(std::get<2>(kids)->get_vitality() == 62500);
+
+  constexpr any16 pasture[] = {grass, grass, grass};
+  constexpr auto fed =
+      encounter_series_counted(goat, span<const any16>(pasture));
+  static_assert(fed.hunter.get_vitality() == 65535 && fed.encounters == 3);
+  static_assert(std::is_same_v<decltype(fed.hunter.as<false, true>()),
+                               Herbivore<species_handle, saturating16>>);
+}
+
+void arena_test_0() {
+  BirthArena arena;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    assert(arena.push({{i}, Diet::herbivore, i}) == i);
+  }
+  const birth_record *first = &arena[0];
+  const size_t capacity = arena.capacity();
+  for (uint32_t i = 0; i < 10000; ++i) {
+    assert(arena[i].species.id == i && arena[i].vitality == i);
+  }
+
+  arena.reset();
+  assert(arena.size() == 0);
+  arena.push({{7}, Diet::plant, 7});
+  // Po reset te same bloki są używane ponownie.
+  assert(&arena[0] == first);
+  assert(arena.capacity() == capacity);
+}
+
+void arena_test_1() {
+  std::mt19937 gen(11);
+  Population<string> population = random_population(1000, gen);
+  std::mt19937_64 generator(12);
+  auto pairs = random_matching(population, generator);
+
+  Population<string> expected = population;
+  encounter_batch(expected, span(pairs));
+
+  BirthArena births;
+  size_t born = encounter_batch(population, span(pairs), births);
+  assert(born == births.size());
+  assert(population.size() == 1000);
+  population.add_births(births);
+  assert(population.size() == expected.size());
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(population.get_vitality(i) == expected.get_vitality(i));
+    assert(population.get_species(i) == expected.get_species(i));
+  }
+}
+
+void arena_test_2() {
+  std::mt19937 gen(13);
+  Population<string> population = random_population(20000, gen);
+  Population<string> expected = population;
+  ThreadPool pool(3);
+  RoundBirths births(pool.size());
+  std::mt19937_64 generator(14), expected_generator(14);
+  for (size_t round = 0; round < 5; ++round) {
+    simulate_round(population, generator, pool, births);
+    auto pairs = random_matching(expected, expected_generator);
+    encounter_batch(expected, span(pairs));
+  }
+
+  assert(population.size() == expected.size());
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(population.get_vitality(i) == expected.get_vitality(i));
+    assert(population.get_diet(i) == expected.get_diet(i));
+  }
+}
+
+size_t count_dead(const Population<string> &population) {
+  size_t dead = 0;
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    dead += population.is_dead(i);
+  }
+  return dead;
+}
+
+void compaction_test_0() {
+  std::mt19937 gen(15);
+  Population<string> population = random_population(2000, gen);
+  assert(population.dead_count() == count_dead(population));
+
+  std::mt19937_64 generator(16);
+  ThreadPool pool(2);
+  for (size_t round = 0; round < 3; ++round) {
+    auto pairs = random_matching(population, generator);
+    encounter_batch_simd(population, span(pairs));
+    assert(population.dead_count() == count_dead(population));
+    simulate_round(population, generator, pool);
+    assert(population.dead_count() == count_dead(population));
+  }
+}
+
+void compaction_test_1() {
+  Population<string> population;
+  population.add(Carnivore<string>("Wilk", 100));
+  population.add(Omnivore<string>("Pies", 0));
+  population.add(Herbivore<string>("Koza", 50));
+  population.add(Plant<string>("Sosna", 0));
+  population.add(Herbivore<string>("Koza", 30));
+  vector<encounter_pair_t> pending = {{0, 2}, {1, 4}, {4, 2}};
+
+  population.set_compaction_threshold(0.5);
+  assert(!population.compact_if_needed(pending));
+  population.set_compaction_threshold(0.4);
+  assert(population.compact_if_needed(pending));
+
+  assert(population.size() == 3);
+  assert(population.dead_count() == 0);
+  assert(population.get_species(0) == "Wilk");
+  assert(population.get_vitality(1) == 50);
+  assert(population.get_vitality(2) == 30);
+  assert((pending == vector<encounter_pair_t>{{0, 1}, {2, 1}}));
+}
+
+void compaction_test_2() {
+  Population<string> population;
+  population.add(Carnivore<string>("Wilk", 100));
+  population.add(Omnivore<string>("Pies", 10));
+  population.set_vitality(1, 0);
+  population.set_vitality(1, 0);
+  assert(population.dead_count() == 1);
+  population.set_vitality(1, 5);
+  assert(population.dead_count() == 0);
+
+  population.set_vitality(0, 0);
+  auto remap = population.compact();
+  assert(remap[0] == Population<string>::removed && remap[1] == 0);
+  assert(population.size() == 1 && population.get_species(0) == "Pies");
+}
+
+void counters_test_0() {
+  reset_encounter_counters();
+  Carnivore<string> wolf("Wilk", 100);
+  encounter(wolf, Carnivore<string>("Wilk", 50));
+  encounter(wolf, Omnivore<string>("Pies", 10));
+  encounter(wolf, Omnivore<string>("Pies", 200));
+  encounter(wolf, Herbivore<string>("Krowa", 0));
+  encounter(Herbivore<string>("Krowa", 10), Plant<string>("Trawa", 5));
+  encounter_series(wolf, Plant<string>("Trawa", 5),
+                   Carnivore<string>("Lew", 100));
+  static_assert(get<0>(encounter(Carnivore<int>(1, 5), Carnivore<int>(2, 3)))
+                    .get_vitality() == 6);
+
+  const encounter_counts counts = encounter_counters();
+  if constexpr (!encounter_counters_enabled) {
+    assert(counts.encounters() == 0);
+    return;
+  }
+  assert(counts[EncounterRule::same_species] == 1);
+  assert(counts[EncounterRule::mutual] == 3);
+  assert(counts[EncounterRule::dead] == 1);
+  assert(counts[EncounterRule::plant_eaten] == 1);
+  assert(counts[EncounterRule::inert] == 1);
+  assert(counts.encounters() == 7);
+  assert(counts.offspring == 1);
+}
+
+// Silniki populacji liczą te same reguły co encounter, także z wielu wątków.
+void counters_test_1() {
+  if constexpr (!encounter_counters_enabled) {
+    return;
+  }
+  std::mt19937 gen(12);
+  const Population<string> population = random_population(20000, gen);
+  std::mt19937_64 generator(13);
+  const auto pairs = random_matching(population, generator);
+
+  reset_encounter_counters();
+  Population<string> expected = population;
+  const size_t births = encounter_batch(expected, span(pairs));
+  const encounter_counts serial = encounter_counters();
+  assert(serial.encounters() == pairs.size());
+  assert(serial.offspring == births);
+
+  reset_encounter_counters();
+  Population<string> simd = population;
+  encounter_batch_simd(simd, span(pairs));
+  assert(encounter_counters().rules == serial.rules);
+  assert(encounter_counters().offspring == serial.offspring);
+
+  reset_encounter_counters();
+  {
+    ThreadPool pool(3);
+    Population<string> result = population;
+    encounter_round(result, span(pairs), pool);
+    assert(encounter_counters().rules == serial.rules);
+  }
+  // Liczniki zakończonych wątków nie giną.
+  assert(encounter_counters().rules == serial.rules);
+  assert(encounter_counters().offspring == serial.offspring);
+}
+
+void vitality_test_0() {
+  constexpr vitality_t max = std::numeric_limits<vitality_t>::max();
+  assert(Carnivore<string>("Wilk", max).add_vitality(2).get_vitality() == 1);
+  assert((Carnivore<string, saturating_vitality>("Wilk", max - 1)
+              .add_vitality(5)
+              .get_vitality() == max));
+
+  static_assert(get<0>(encounter(Carnivore<int, saturating_vitality>(1, max),
+                                 Herbivore<int, saturating_vitality>(2, 10)))
+                    .get_vitality() == max);
+  static_assert(get<2>(encounter(Omnivore<int, saturating_vitality>(1, max),
+                                 Omnivore<int, saturating_vitality>(1, max)))
+                    ->get_vitality() == max);
+  static_assert(get<0>(encounter(Herbivore<int, checked_vitality>(1, 10),
+                                 Plant<int, checked_vitality>(2, 5)))
+                    .get_vitality() == 15);
+
+  bool thrown = false;
+  try {
+    encounter(Herbivore<string, checked_vitality>("Krowa", max),
+              Plant<string, checked_vitality>("Trawa", 1));
+  } catch (std::overflow_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  auto series = encounter_series(Omnivore<int, saturating_vitality>(1, max),
+                                 Plant<int, saturating_vitality>(2, 5),
+                                 Herbivore<int, saturating_vitality>(3, 7));
+  assert(series.get_vitality() == max);
+}
+
+// Populacja, w której co drugi organizm ma witalność bliską maksymalnej.
+template <typename policy_t>
+Population<string, policy_t> overflowing_population() {
+  std::mt19937 gen(14);
+  auto population = random_population<policy_t>(20000, gen);
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    if (gen() % 2 == 0) {
+      population.set_vitality(
+          i, std::numeric_limits<typename policy_t::value_type>::max() -
+                 gen() % 100);
+    }
+  }
+  return population;
+}
+
+// Jądra wektorowe i równoległe nasycają tak samo jak encounter_outcome_of,
+// a przy sprawdzaniu zatrzymują się na tej samej parze.
+template <typename width_t>
+void vitality_test_1() {
+  using saturating = basic_saturating_vitality<width_t>;
+  using checked = basic_checked_vitality<width_t>;
+  const auto population = overflowing_population<saturating>();
+  std::mt19937_64 generator(15);
+  auto pairs = random_matching(population, generator);
+
+  auto expected = population;
+  encounter_batch(expected, span(pairs));
+  auto simd = population;
+  encounter_batch_simd(simd, span(pairs));
+  auto bucketed = population;
+  encounter_batch_bucketed(bucketed, span(pairs));
+  auto round = population;
+  ThreadPool pool(3);
+  encounter_round(round, span(pairs), pool);
+  assert(simd.size() == expected.size() && round.size() == expected.size());
+  assert(bucketed.size() == expected.size());
+  for (population_index_t i = 0; i < expected.size(); ++i) {
+    assert(simd.get_vitality(i) == expected.get_vitality(i));
+    assert(bucketed.get_vitality(i) == expected.get_vitality(i));
+    assert(round.get_vitality(i) == expected.get_vitality(i));
+  }
+
+  auto checked_scalar = overflowing_population<checked>();
+  auto checked_simd = checked_scalar;
+  bool scalar_thrown = false, simd_thrown = false;
+  try {
+    encounter_batch(checked_scalar, span(pairs));
+  } catch (std::overflow_error &) {
+    scalar_thrown = true;
+  }
+  try {
+    encounter_batch_simd(checked_simd, span(pairs));
+  } catch (std::overflow_error &) {
+    simd_thrown = true;
+  }
+  assert(scalar_thrown && simd_thrown);
+  assert(checked_simd.size() == checked_scalar.size());
+  for (population_index_t i = 0; i < checked_scalar.size(); ++i) {
+    assert(checked_simd.get_vitality(i) == checked_scalar.get_vitality(i));
+  }
+}
+
+// Węższe witalności zmniejszają organizmy i nie zmieniają wyników, dopóki
+// witalności się w nich mieszczą.
+void vitality_test_2() {
+  using narrow = basic_saturating_vitality<uint16_t>;
+  using narrow_wrapping = basic_wrapping_vitality<uint16_t>;
+  static_assert(sizeof(Carnivore<uint16_t, narrow>) == 4);
+  static_assert(sizeof(Carnivore<uint32_t, checked_vitality>) == 16);
+  static_assert(get<0>(encounter(Omnivore<int, narrow>(1, 65000),
+                                 Herbivore<int, narrow>(2, 1000)))
+                    .get_vitality() == 65500);
+  static_assert(get<0>(encounter(Omnivore<int, narrow>(1, 65000),
+                                 Plant<int, narrow>(2, 1000)))
+                    .get_vitality() == 65535);
+  static_assert(get<0>(encounter(Omnivore<int, narrow_wrapping>(1, 65000),
+                                 Plant<int, narrow_wrapping>(2, 1000)))
+                    .get_vitality() == 464);
+
+  std::mt19937 gen(16);
+  const Population<string> wide = random_population(20000, gen);
+  gen.seed(16);
+  const auto narrow_population = random_population<narrow>(20000, gen);
+  std::mt19937_64 generator(17);
+  auto pairs = random_matching(wide, generator);
+
+  Population<string> wide_result = wide;
+  encounter_batch_simd(wide_result, span(pairs));
+  auto narrow_result = narrow_population;
+  encounter_batch_simd(narrow_result, span(pairs));
+  assert(narrow_result.size() == wide_result.size());
+  for (population_index_t i = 0; i < wide_result.size(); ++i) {
+    assert(narrow_result.get_vitality(i) == wide_result.get_vitality(i));
+  }
+}
+
+using step = std::pair<size_t, size_t>;
+
+// Cały scenariusz przeliczony w czasie kompilacji.
+constexpr auto scenario = simulate<8>(
+    std::array{AnyOrganism<int>(1, Diet::carnivore, 100),
+               AnyOrganism<int>(1, Diet::carnivore, 50),
+               AnyOrganism<int>(2, Diet::herbivore, 30),
+               AnyOrganism<int>(3, Diet::plant, 5)},
+    std::array{std::array{step{0, 1}, step{2, 3}},
+               std::array{step{0, 2}, step{1, 3}},
+               std::array{step{4, 0}, step{4, 1}}});
+
+void ecosystem_test_0() {
+  static_assert(scenario.size() == 7);
+  static_assert(scenario.get_vitality(0) == 117);
+  static_assert(scenario.get_vitality(2) == 0);
+  static_assert(scenario.get_vitality(3) == 0);
+  static_assert(scenario.get_vitality(4) == 75);
+  static_assert(scenario.get_vitality(5) == 96);
+  static_assert(scenario.get_vitality(6) == 62);
+  static_assert(scenario.get_diet(6) == Diet::carnivore);
+
+  constexpr auto grown = [] {
+    Ecosystem<int, 4> ecosystem;
+    ecosystem.add(Omnivore<int>(7, 10));
+    ecosystem.add(Omnivore<int>(7, 20));
+    for (int round = 0; round < 2; ++round) {
+      ecosystem.encounter_round(std::array{step{0, 1}});
+    }
+    return ecosystem;
+  }();
+  static_assert(grown.size() == 4 && grown.get_vitality(3) == 15);
+
+  // Organizm spotykający sam siebie jest tego samego gatunku.
+  constexpr auto alone = [] {
+    Ecosystem<int, 2> ecosystem;
+    ecosystem.add(Omnivore<int>(7, 10));
+    ecosystem.encounter_round(std::array{step{0, 0}});
+    return ecosystem;
+  }();
+  static_assert(alone.size() == 2 && alone.get_vitality(0) == 10 &&
+                alone.get_vitality(1) == 10);
+
+  bool thrown = false;
+  try {
+    simulate<3>(std::array{AnyOrganism<int>(1, Diet::carnivore, 10),
+                           AnyOrganism<int>(1, Diet::carnivore, 20)},
+                std::array{std::array{step{0, 1}}, std::array{step{0, 1}}});
+  } catch (std::length_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // Polityka z simulate; witalności spoza typu polityki nie są obcinane.
+  using saturating16 = basic_saturating_vitality<uint16_t>;
+  constexpr auto saturated = simulate<3, saturating16>(
+      std::array{AnyOrganism<int>(1, Diet::herbivore, 65000),
+                 AnyOrganism<int>(2, Diet::plant, 1000)},
+      std::array{std::array{step{0, 1}}, std::array{step{0, 1}}});
+  static_assert(saturated.get_vitality(0) == 65535);
+  static_assert(saturated.get_vitality(1) == 0);
+  thrown = false;
+  try {
+    Ecosystem<int, 4, saturating16> ecosystem(
+        std::array{AnyOrganism<int>(1, Diet::herbivore, 70000)});
+  } catch (const out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+// Ten sam losowy scenariusz w Ecosystem i w Population.
+void ecosystem_test_1() {
+  std::mt19937 gen(18);
+  const Diet diets[] = {Diet::carnivore, Diet::omnivore, Diet::herbivore,
+                        Diet::plant};
+  Population<int> population;
+  auto ecosystem = std::make_unique<Ecosystem<int, 4096>>();
+  for (size_t i = 0; i < 1000; ++i) {
+    const int species = gen() % 3;
+    const Diet diet = diets[gen() % 4];
+    const vitality_t vitality = gen() % 4 * 20;
+    population.add(species, diet, vitality);
+    ecosystem->add(species, diet, vitality);
+  }
+  for (size_t round = 0; round < 5; ++round) {
+    vector<step> steps;
+    vector<encounter_pair_t> pairs;
+    for (size_t i = 0; i < 300; ++i) {
+      const population_index_t i1 = gen() % population.size();
+      // Także pary organizmu z samym sobą.
+      const population_index_t i2 =
+          i % 50 == 0 ? i1 : gen() % population.size();
+      if (!diet_is_plant(population.get_diet(i1)) ||
+          !diet_is_plant(population.get_diet(i2))) {
+        steps.emplace_back(i1, i2);
+        pairs.emplace_back(i1, i2);
+      }
+    }
+    const size_t births = ecosystem->encounter_round(steps);
+    assert(births == encounter_batch(population, span(pairs)));
+  }
+  assert(ecosystem->size() == population.size());
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(ecosystem->get_vitality(i) == population.get_vitality(i));
+    assert(ecosystem->get_species(i) == population.get_species(i));
+  }
+}
+
+SpatialGrid random_grid(size_t size, std::mt19937 &gen) {
+  SpatialGrid grid(2.0f, 20, 10);
+  std::uniform_real_distribution<float> x(-1.0f, 41.0f);
+  std::uniform_real_distribution<float> y(-1.0f, 21.0f);
+  for (size_t i = 0; i < size; ++i) {
+    grid.add({x(gen), y(gen)});
+  }
+  return grid;
+}
+
+void spatial_test_0() {
+  static_assert(morton_code(0, 0) == 0);
+  static_assert(morton_code(1, 0) == 1);
+  static_assert(morton_code(0, 1) == 2);
+  static_assert(morton_code(3, 3) == 15);
+  static_assert(morton_code(0xFFFF, 0xFFFF) == UINT32_MAX);
+
+  bool thrown = false;
+  try {
+    SpatialGrid(0.0f, 10, 10);
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  SpatialGrid small(1.0f, 4, 4);
+  small.add({-3.0f, 2.5f});
+  small.add({10.0f, 10.0f});
+  assert(small.cell_of(0) == std::make_pair(0u, 2u));
+  assert(small.cell_of(1) == std::make_pair(3u, 3u));
+  assert(!small.are_neighbours(0, 1));
+
+  std::mt19937 gen(20);
+  Population<string> population = random_population(2000, gen);
+  SpatialGrid grid = random_grid(population.size(), gen);
+  const Population<string> original = population;
+  const SpatialGrid original_grid = grid;
+  const auto remap = sort_by_cells(population, grid);
+  assert(population.size() == original.size());
+  for (population_index_t i = 0; i < original.size(); ++i) {
+    const population_index_t moved = remap[i];
+    assert(population.get_species(moved) == original.get_species(i));
+    assert(population.get_vitality(moved) == original.get_vitality(i));
+    assert(population.get_diet(moved) == original.get_diet(i));
+    assert(grid.get_position(moved).x == original_grid.get_position(i).x);
+  }
+  for (population_index_t i = 1; i < grid.size(); ++i) {
+    assert(grid.cell_code(i - 1) <= grid.cell_code(i));
+  }
+
+  thrown = false;
+  try {
+    vector<population_index_t> order(population.size(), 0);
+    population.reorder(order);
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+// Pary sąsiadów są rozłączne, a dzieci stają obok rodziców. Wynik nie zależy
+// od liczby wątków.
+void spatial_test_1() {
+  std::mt19937 gen(21);
+  Population<string> population = random_population(5000, gen);
+  SpatialGrid grid = random_grid(population.size(), gen);
+  const CounterRng rng(22);
+
+  const auto pairs = spatial_matching(population, grid, rng, 0);
+  vector<size_t> seen(population.size());
+  for (const auto &[index1, index2] : pairs) {
+    assert(grid.are_neighbours(index1, index2));
+    assert(!population.is_dead(index1) && !population.is_dead(index2));
+    assert(!diet_is_plant(population.get_diet(index1)) ||
+           !diet_is_plant(population.get_diet(index2)));
+    ++seen[index1];
+    ++seen[index2];
+  }
+  assert(std::all_of(seen.begin(), seen.end(),
+                     [](size_t count) { return count <= 1; }));
+  assert(spatial_matching(population, grid, rng, 1) != pairs);
+
+  ThreadPool serial(1);
+  Population<string> expected = population;
+  SpatialGrid expected_grid = grid;
+  size_t born = 0;
+  for (uint64_t round = 0; round < 5; ++round) {
+    const size_t old_size = expected.size();
+    const auto round_pairs =
+        spatial_matching(expected, expected_grid, rng, round);
+    born += simulate_spatial_round(expected, expected_grid, rng, round, serial);
+    assert(expected_grid.size() == expected.size());
+    size_t child = old_size;
+    for (const auto &[index1, index2] : round_pairs) {
+      if (expected.get_species(index1) == expected.get_species(index2) &&
+          expected.get_diet(index1) == expected.get_diet(index2)) {
+        assert(expected.get_species(child) == expected.get_species(index1));
+        assert(expected_grid.get_position(child).x ==
+               expected_grid.get_position(index1).x);
+        ++child;
+      }
+    }
+    assert(child == expected.size());
+  }
+  assert(born > 0);
+
+  for (size_t threads : {2, 5}) {
+    ThreadPool pool(threads);
+    Population<string> result = population;
+    SpatialGrid result_grid = grid;
+    for (uint64_t round = 0; round < 5; ++round) {
+      simulate_spatial_round(result, result_grid, rng, round, pool);
+    }
+    assert(result.size() == expected.size());
+    for (population_index_t i = 0; i < result.size(); ++i) {
+      assert(result.get_vitality(i) == expected.get_vitality(i));
+      assert(result_grid.get_position(i).y == expected_grid.get_position(i).y);
+    }
+  }
+
+  // Każde spotkanie rundy jest liczone raz.
+  const auto round_pairs = spatial_matching(population, grid, rng, 0);
+  reset_encounter_counters();
+  simulate_spatial_round(population, grid, rng, 0, serial);
+  if constexpr (encounter_counters_enabled) {
+    assert(encounter_counters().encounters() == round_pairs.size());
+  }
+}
+
+string snapshot_path(const string &name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+void snapshot_test_0() {
+  std::mt19937 gen(23);
+  Population<string> population = random_population(10000, gen);
+  population.add("Gatunek bez dzieci", Diet::plant, 7);
+  const string path = snapshot_path("jnp1_snapshot_test_0.bin");
+  save_snapshot(path, population);
+
+  const PopulationSnapshot<string> snapshot(path);
+  assert(snapshot.size() == population.size());
+  assert(snapshot.species_count() == population.get_registry().size());
+  assert(reinterpret_cast<uintptr_t>(snapshot.get_vitalities().data()) %
+             snapshot_alignment ==
+         0);
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(snapshot.get_vitalities()[i] == population.get_vitality(i));
+    assert(snapshot.get_diets()[i] == population.get_diet(i));
+    assert(snapshot.get_species(snapshot.get_species_handles()[i]) ==
+           population.get_species(i));
+  }
+
+  Population<string> loaded = snapshot.load();
+  assert(loaded.size() == population.size());
+  assert(loaded.dead_count() == population.dead_count());
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(loaded.get_species_handle(i) == population.get_species_handle(i));
+    assert(loaded.get_species(i) == population.get_species(i));
+    assert(loaded.get_vitality(i) == population.get_vitality(i));
+  }
+  // Po wczytaniu symulacja idzie dalej tak samo jak na oryginale.
+  vector<encounter_pair_t> pairs;
+  for (population_index_t i = 0; i + 1 < population.size(); i += 2) {
+    if (!diet_is_plant(population.get_diet(i)) ||
+        !diet_is_plant(population.get_diet(i + 1))) {
+      pairs.emplace_back(i, i + 1);
+    }
+  }
+  assert(encounter_batch(loaded, span(pairs)) ==
+         encounter_batch(population, span(pairs)));
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(loaded.get_vitality(i) == population.get_vitality(i));
+  }
+  std::filesystem::remove(path);
+
+  // Zrzut w pamięci musi zaczynać się od granicy snapshot_alignment.
+  std::ostringstream out;
+  write_snapshot(out, population);
+  const string image = std::move(out).str();
+  vector<snapshot_block> buffer(image.size() / snapshot_alignment + 2);
+  const auto memory = std::as_writable_bytes(span(buffer));
+  std::ranges::copy(std::as_bytes(span(image)), memory.begin());
+  assert(PopulationSnapshot<string>(memory.first(image.size())).size() ==
+         population.size());
+  std::ranges::copy(std::as_bytes(span(image)), memory.begin() + 16);
+  bool thrown = false;
+  try {
+    PopulationSnapshot<string>(memory.subspan(16, image.size()));
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+// Inna szerokość witalności i gatunki kopiowane bajtowo; pliki niepasujące do
+// typu albo uszkodzone są odrzucane.
+void snapshot_test_1() {
+  using policy = basic_saturating_vitality<uint16_t>;
+  Population<int, policy> population;
+  population.add(Carnivore<int, policy>(12, 65535));
+  population.add(Plant<int, policy>(-3, 0));
+  population.add(Omnivore<int, policy>(12, 17));
+  const string path = snapshot_path("jnp1_snapshot_test_1.bin");
+  save_snapshot(path, population);
+
+  const auto loaded = load_snapshot<int, policy>(path);
+  assert(loaded.size() == 3);
+  assert(loaded.get_species(1) == -3);
+  assert(loaded.get_vitality(0) == 65535);
+  assert(loaded.is_dead(1));
+  assert(loaded.get_diet(2) == Diet::omnivore);
+
+  bool thrown = false;
+  try {
+    PopulationSnapshot<int>{path};
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  const auto size = std::filesystem::file_size(path);
+  std::filesystem::resize_file(path, size - 1);
+  thrown = false;
+  try {
+    PopulationSnapshot<int, policy>{path};
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // Witalność ponad vitality_max polityki, np. zapisana szerszą polityką.
+  Population<int> wide;
+  wide.add(1, Diet::herbivore, packed_vitality_max);
+  wide.add(1, Diet::herbivore, packed_vitality_max + 1);
+  save_snapshot(path, wide);
+  assert(load_snapshot<int>(path).size() == 2);
+  thrown = false;
+  try {
+    PopulationSnapshot<int, packed_wrapping_vitality>{path};
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  std::ofstream(path, std::ios::binary) << "not a snapshot at all";
+  thrown = false;
+  try {
+    PopulationSnapshot<int, policy>{path};
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  std::filesystem::remove(path);
+  thrown = false;
+  try {
+    PopulationSnapshot<int, policy>{path};
+  } catch (const std::system_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+vector<encounter_event> read_events(const string &path) {
+  std::ifstream in(path, std::ios::binary);
+  const auto bytes = std::filesystem::file_size(path);
+  vector<encounter_event> events(bytes / sizeof(encounter_event));
+  in.read(reinterpret_cast<char *>(events.data()),
+          static_cast<std::streamsize>(bytes));
+  return events;
+}
+
+// Każde spotkanie rundy liczonej na kilku wątkach ma w dzienniku rekord
+// zgodny ze skutkiem policzonym po kolei.
+void event_log_test_0() {
+  std::mt19937 gen(24);
+  Population<string> population = random_population(20000, gen);
+  std::mt19937_64 generator(25);
+  const string path = snapshot_path("jnp1_event_log_test_0.bin");
+  ThreadPool pool(3);
+  EncounterEventLog log(path, pool.size());
+  RoundBirths births(pool.size());
+  std::map<std::tuple<uint32_t, population_index_t, population_index_t>,
+           encounter_event>
+      expected;
+  size_t total = 0;
+  for (uint32_t round = 0; round < 3; ++round) {
+    const auto pairs = random_matching(population, generator);
+    for (const auto &[index1, index2] : pairs) {
+      const auto outcome = encounter_outcome_at(population, index1, index2);
+      expected[{round, index1, index2}] = {round,
+                                           index1,
+                                           index2,
+                                           outcome.rule,
+                                           outcome.has_child,
+                                           0,
+                                           outcome.vitality1,
+                                           outcome.vitality2};
+    }
+    encounter_round(population, span(pairs), pool, births,
+                    log.recorder(round, pool));
+    total += pairs.size();
+    log.flush();
+  }
+  assert(log.written_count() == total);
+
+  const auto events = read_events(path);
+  assert(events.size() == total);
+  size_t births_logged = 0;
+  for (const auto &event : events) {
+    const auto &match =
+        expected.at({event.round, event.index1, event.index2});
+    assert(event.rule == match.rule);
+    assert(event.has_child == match.has_child);
+    assert(event.vitality1 == match.vitality1);
+    assert(event.vitality2 == match.vitality2);
+    births_logged += event.has_child &&
+                     (event.rule == EncounterRule::same_species);
+  }
+  assert(births_logged > 0);
+
+  bool thrown = false;
+  try {
+    ThreadPool bigger(4);
+    log.recorder(0, bigger);
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+  log.recorder(UINT32_MAX, pool);
+  thrown = false;
+  try {
+    log.recorder(uint64_t{UINT32_MAX} + 1, pool);
+  } catch (const out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+  std::filesystem::remove(path);
+}
+
+// Mały bufor: wątki symulacji czekają na zapis, ale nic nie ginie.
+void event_log_test_1() {
+  const string path = snapshot_path("jnp1_event_log_test_1.bin");
+  {
+    ThreadPool pool(2);
+    EncounterEventLog log(path, pool.size(), 3);
+    pool.parallel_for(8, [&](size_t task, size_t worker) {
+      for (uint32_t i = 0; i < 1000; ++i) {
+        log.push(worker, {static_cast<uint32_t>(task), i, i + 1,
+                          EncounterRule::inert, false, 0, task, i});
+      }
+    });
+  }
+  const auto events = read_events(path);
+  assert(events.size() == 8000);
+  vector<uint32_t> next(8);
+  for (const auto &event : events) {
+    assert(event.index1 == event.vitality2);
+    // Zdarzenia jednego zadania liczy jeden wątek, więc są w kolejności.
+    assert(event.index1 == next[event.round]++);
+  }
+  std::filesystem::remove(path);
+}
+
+void assert_same_statistics(const PopulationStatistics &stats,
+                            const PopulationStatistics &expected,
+                            size_t species_count) {
+  assert(stats.live_count() == expected.live_count());
+  assert(stats.biomass() == expected.biomass());
+  for (uint32_t id = 0; id < species_count; ++id) {
+    assert(stats.live_count(species_handle{id}) ==
+           expected.live_count(species_handle{id}));
+    assert(stats.biomass(species_handle{id}) ==
+           expected.biomass(species_handle{id}));
+  }
+  for (Diet diet :
+       {Diet::plant, Diet::herbivore, Diet::carnivore, Diet::omnivore}) {
+    assert(stats.live_count(diet) == expected.live_count(diet));
+    assert(stats.biomass(diet) == expected.biomass(diet));
+  }
+}
+
+// Statystyki poprawiane po każdej rundzie zgadzają się z policzonymi od nowa.
+void stats_test_0() {
+  std::mt19937 gen(26);
+  Population<string> population = random_population(20000, gen);
+  PopulationStatistics stats(population);
+  assert(stats.live_count() == population.size() - population.dead_count());
+
+  ThreadPool pool(3);
+  RoundBirths births(pool.size());
+  const CounterRng rng(27);
+  for (uint64_t round = 0; round < 6; ++round) {
+    const auto pairs = random_matching(population, rng, round, pool);
+    const size_t born = encounter_round(population, span(pairs), pool, births,
+                                        stats.recorder(population, pool));
+    stats.commit(population, born);
+    assert_same_statistics(stats, PopulationStatistics(population),
+                           population.get_registry().size());
+    if (round == 3) {
+      population.compact();
+      assert_same_statistics(stats, PopulationStatistics(population),
+                             population.get_registry().size());
+    }
+  }
+  assert(stats.live_count() == population.size() - population.dead_count());
+
+  // Z carrying_capacity liczą się tylko dzieci, które zostały dopisane.
+  Population<string> herd;
+  for (int i = 0; i < 100; ++i) {
+    herd.add(Herbivore<string>("Sarna", 10));
+  }
+  herd.set_carrying_capacity(110);
+  PopulationStatistics herd_stats(herd);
+  vector<encounter_pair_t> mates;
+  for (population_index_t i = 0; i < 100; i += 2) {
+    mates.emplace_back(i, i + 1);
+  }
+  const size_t born = encounter_round(herd, span(mates), pool, births,
+                                      herd_stats.recorder(herd, pool));
+  herd_stats.commit(herd, born);
+  assert(born == 10);
+  assert(herd_stats.live_count() == 110);
+  assert(herd_stats.biomass() == 1100);
+  assert_same_statistics(herd_stats, PopulationStatistics(herd),
+                         herd.get_registry().size());
+}
+
+// Organizmy dopisane poza rundą, w tym nowego gatunku.
+void stats_test_1() {
+  Population<string> population;
+  population.add(Carnivore<string>("Wilk", 10));
+  population.add(Herbivore<string>("Sarna", 4));
+  PopulationStatistics stats(population);
+  const auto pine = population.add("Sosna", Diet::plant, 7);
+  stats.add(population.get_species_handle(pine), Diet::plant, 7);
+  population.add("Sosna", Diet::plant, 0);
+  stats.add(population.get_species_handle(pine), Diet::plant, 0);
+  assert(stats.live_count() == 3);
+  assert(stats.biomass() == 21);
+  assert(stats.live_count(population.get_species_handle(pine)) == 1);
+  assert(stats.biomass(Diet::plant) == 7);
+  assert(stats.live_count(species_handle{100}) == 0);
+
+  ThreadPool pool(1);
+  population.add(Herbivore<string>("Sarna", 3));
+  stats.add(population.get_species_handle(4), Diet::herbivore, 3);
+  const vector<encounter_pair_t> meals = {{0, 1}, {4, 2}};
+  const size_t born = encounter_round(population, span(meals), pool,
+                                      stats.recorder(population, pool));
+  stats.commit(population, born);
+  // Wilk zjada sarnę, druga sarna zjada sosnę.
+  assert(stats.live_count() == 2);
+  assert(stats.biomass() == 12 + 10);
+  assert(stats.live_count(Diet::plant) == 0);
+  assert_same_statistics(stats, PopulationStatistics(population),
+                         population.get_registry().size());
+}
+
+// Z pojemnością populacji dopisywane są tylko pierwsze dzieci rundy, te same,
+// które dostałaby populacja bez ograniczenia.
+void capacity_test_0() {
+  std::mt19937 gen(28);
+  Population<string> population = random_population(20000, gen);
+  const CounterRng rng(29);
+  ThreadPool pool(3);
+  RoundBirths births(pool.size());
+  const auto pairs = random_matching(population, rng, 0, pool);
+
+  Population<string> unlimited = population;
+  const size_t all_born = encounter_round(unlimited, span(pairs), pool, births);
+  assert(all_born > 20);
+
+  // Miejsce liczy się po zabitych w tej rundzie, przed dopisaniem dzieci.
+  const size_t live_before_births =
+      unlimited.size() - unlimited.dead_count() - all_born;
+  population.set_carrying_capacity(live_before_births + 20);
+  const size_t born = encounter_round(population, span(pairs), pool, births);
+  assert(births.size() == all_born);
+  assert(born == 20);
+  assert(population.size() == 20000 + born);
+  assert(population.birth_room() == 0);
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(population.get_vitality(i) == unlimited.get_vitality(i));
+    assert(population.get_species(i) == unlimited.get_species(i));
+  }
+
+  // Pełna populacja: spotkania się odbywają, ale dzieci nie przybywa.
+  population.set_carrying_capacity(0);
+  assert(population.birth_room() == 0);
+  const size_t size = population.size();
+  const auto next = random_matching(population, rng, 1, pool);
+  assert(encounter_round(population, span(next), pool, births) == 0);
+  assert(births.size() > 0);
+  assert(population.size() == size);
+}
+
+void capacity_test_1() {
+  Population<string> population;
+  population.add(Omnivore<string>("Pies", 10));
+  population.add(Omnivore<string>("Pies", 20));
+  population.add(Omnivore<string>("Pies", 30));
+  population.add(Omnivore<string>("Pies", 40));
+  population.add(Omnivore<string>("Pies", 0));
+  population.set_carrying_capacity(5);
+  BirthArena births;
+  const vector<encounter_pair_t> pairs = {{0, 1}, {2, 3}};
+  assert(encounter_batch(population, span(pairs), births) == 2);
+  assert(population.add_births(births) == 1);
+  assert(population.size() == 6);
+  assert(population.get_vitality(5) == 15);
+
+  RoundBirths round_births;
+  round_births.reset(1, 1);
+  round_births.arena(0).push({species_handle{0}, Diet::omnivore, 1});
+  round_births.arena(0).push({species_handle{0}, Diet::omnivore, 2});
+  round_births.set_chunk(0, 0, 0, 2);
+  size_t seen = 0;
+  round_births.for_each([&](const birth_record &) { ++seen; }, 1);
+  assert(seen == 1);
+}
+
+void sharding_test_0() {
+  static_assert(shard_first_row(0, 3, 12, 1) == 0);
+  static_assert(shard_first_row(1, 3, 12, 0) == 4);
+  static_assert(shard_first_row(1, 3, 12, 1) == 5);
+  static_assert(shard_first_row(3, 3, 12, 1) == 12);
+  static_assert(shard_of_row(4, 3, 12, 0) == 1);
+  static_assert(shard_of_row(4, 3, 12, 1) == 0);
+  static_assert(shard_of_row(11, 3, 12, 1) == 2);
+
+  // Jeden shard to zwykła runda sąsiadów na siatce.
+  std::mt19937 gen(30);
+  Population<string> population = random_population(3000, gen);
+  SpatialGrid grid = random_grid(population.size(), gen);
+  LocalNetwork network(1);
+  LocalTransport transport(network, 0);
+  Shard<string> shard(transport, 2.0f, 20, 10);
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(shard.owns(grid.get_position(i), 0));
+    shard.add(population.get_species(i), population.get_diet(i),
+              population.get_vitality(i), grid.get_position(i));
+  }
+
+  // Wymiana z jednym shardem tylko usuwa martwe, jak compact.
+  const CounterRng rng(31);
+  ThreadPool pool(2);
+  for (uint64_t round = 0; round < 4; ++round) {
+    const size_t born = shard.simulate_round(rng, round, pool);
+    grid.apply_remap(population.compact());
+    assert(born == simulate_spatial_round(population, grid, rng, round, pool));
+  }
+  const auto &result = shard.get_population();
+  assert(result.size() == population.size());
+  for (population_index_t i = 0; i < result.size(); ++i) {
+    assert(result.get_vitality(i) == population.get_vitality(i));
+    assert(result.get_species(i) == population.get_species(i));
+    assert(shard.get_grid().get_position(i).x == grid.get_position(i).x);
+  }
+}
+
+struct migrant {
+  string species;
+  Diet diet;
+  vitality_t vitality;
+  float x, y;
+
+  bool operator<(const migrant &other) const {
+    return std::tie(species, diet, vitality, x, y) <
+           std::tie(other.species, other.diet, other.vitality, other.x,
+                    other.y);
+  }
+};
+
+// Wymiana przenosi organizmy do właścicieli ich wierszy, niczego nie gubiąc
+// i niczego nie podwajając.
+void sharding_test_1() {
+  constexpr size_t ranks = 3;
+  LocalNetwork network(ranks);
+  vector<LocalTransport> transports;
+  vector<std::unique_ptr<Shard<string>>> shards;
+  for (size_t rank = 0; rank < ranks; ++rank) {
+    transports.emplace_back(network, rank);
+  }
+  for (size_t rank = 0; rank < ranks; ++rank) {
+    shards.push_back(
+        std::make_unique<Shard<string>>(transports[rank], 1.0f, 8, 12));
+  }
+  std::mt19937 gen(32);
+  const string names[] = {"Dinozaur", "Tyranozaur", "Dodo"};
+  const Diet diets[] = {Diet::carnivore, Diet::omnivore, Diet::herbivore,
+                        Diet::plant};
+  std::uniform_real_distribution<float> x(0.0f, 8.0f);
+  std::uniform_real_distribution<float> y(0.0f, 12.0f);
+  vector<migrant> expected;
+  for (size_t i = 0; i < 3000; ++i) {
+    // Wszystkie zaczynają w shardzie 0, więc większość musi się przenieść.
+    const migrant organism{names[gen() % 3], diets[gen() % 4],
+                           gen() % 100 + 1, x(gen), y(gen)};
+    shards[0]->add(organism.species, organism.diet, organism.vitality,
+                   {organism.x, organism.y});
+    expected.push_back(organism);
+  }
+  std::sort(expected.begin(), expected.end());
+
+  for (uint64_t round = 0; round < 2; ++round) {
+    vector<std::thread> threads;
+    for (size_t rank = 0; rank < ranks; ++rank) {
+      threads.emplace_back([&, rank] { shards[rank]->exchange(round); });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    vector<migrant> found;
+    for (size_t rank = 0; rank < ranks; ++rank) {
+      const auto &population = shards[rank]->get_population();
+      const auto &grid = shards[rank]->get_grid();
+      assert(grid.size() == population.size());
+      for (population_index_t i = 0; i < population.size(); ++i) {
+        assert(shards[rank]->owns(grid.get_position(i), round));
+        found.push_back({population.get_species(i), population.get_diet(i),
+                         population.get_vitality(i), grid.get_position(i).x,
+                         grid.get_position(i).y});
+      }
+    }
+    std::sort(found.begin(), found.end());
+    assert(found.size() == expected.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+      assert(!(found[i] < expected[i]) && !(expected[i] < found[i]));
+    }
+  }
+
+  // Martwe organizmy z cudzych pasów nie są wysyłane.
+  LocalNetwork pair_network(2);
+  LocalTransport transport0(pair_network, 0);
+  LocalTransport transport1(pair_network, 1);
+  Shard<string> shard0(transport0, 1.0f, 8, 12);
+  Shard<string> shard1(transport1, 1.0f, 8, 12);
+  assert(shard1.owns({1.0f, 9.0f}, 0));
+  shard0.add("Dodo", Diet::herbivore, 0, {1.0f, 9.0f});
+  shard0.add("Dodo", Diet::herbivore, 5, {2.0f, 9.0f});
+  std::thread sender([&] { shard0.exchange(0); });
+  assert(shard1.exchange(0) == 1);
+  sender.join();
+  assert(shard0.get_population().size() == 0);
+  assert(shard1.get_population().size() == 1);
+  assert(shard1.get_population().dead_count() == 0);
+  assert(shard1.get_population().get_vitality(0) == 5);
+
+  // Żaden shard nie ma nic do wysłania: wiadomości są puste.
+  assert(shard0.owns({1.0f, 1.0f}, 1));
+  shard0.add("Dodo", Diet::herbivore, 7, {1.0f, 1.0f});
+  std::thread idle([&] { assert(shard0.exchange(1) == 0); });
+  assert(shard1.exchange(1) == 0);
+  idle.join();
+  assert(shard0.get_population().size() == 1);
+  assert(shard1.get_population().size() == 1);
+}
+
+// Pełne rundy na shardach w osobnych wątkach.
+void sharding_test_2() {
+  constexpr size_t ranks = 2;
+  LocalNetwork network(ranks);
+  vector<LocalTransport> transports;
+  for (size_t rank = 0; rank < ranks; ++rank) {
+    transports.emplace_back(network, rank);
+  }
+  Shard<string> shard0(transports[0], 2.0f, 20, 10);
+  Shard<string> shard1(transports[1], 2.0f, 20, 10);
+  std::mt19937 gen(33);
+  const Population<string> population = random_population(4000, gen);
+  const SpatialGrid grid = random_grid(population.size(), gen);
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    auto &shard = i % 2 == 0 ? shard0 : shard1;
+    shard.add(population.get_species(i), population.get_diet(i),
+              population.get_vitality(i), grid.get_position(i));
+  }
+
+  const CounterRng rng(34);
+  size_t born = 0;
+  std::mutex born_mutex;
+  auto run = [&](Shard<string> &shard) {
+    ThreadPool pool(2);
+    for (uint64_t round = 0; round < 6; ++round) {
+      const size_t shard_born = shard.simulate_round(rng, round, pool);
+      std::lock_guard lock(born_mutex);
+      born += shard_born;
+    }
+  };
+  std::thread thread0(run, std::ref(shard0));
+  std::thread thread1(run, std::ref(shard1));
+  thread0.join();
+  thread1.join();
+  assert(born > 0);
+  for (Shard<string> *shard : {&shard0, &shard1}) {
+    assert(shard->get_grid().size() == shard->get_population().size());
+    for (population_index_t i = 0; i < shard->get_population().size(); ++i) {
+      assert(shard->owns(shard->get_grid().get_position(i), 5));
+    }
+  }
+}
+
+// Populacja na akceleratorze przez kilka rund liczy to samo co na procesorze.
+template <typename policy_t>
+void device_test_0() {
+  std::mt19937 gen(33);
+  Population<string, policy_t> population =
+      random_population<policy_t>(20000, gen);
+  population.set_carrying_capacity(20500);
+  // Mała pojemność, żeby kolumny na akceleratorze musiały urosnąć.
+  DevicePopulation<string, policy_t> device(population, 100);
+  assert(device.capacity() == 20000);
+  const CounterRng rng(34);
+  ThreadPool pool(2);
+  for (uint64_t round = 0; round < 4; ++round) {
+    const auto pairs = random_matching(population, rng, round, pool);
+    const size_t born = encounter_round(population, span(pairs), pool);
+    assert(device.encounter_batch(span(pairs)) == born);
+    assert(device.size() == population.size());
+    assert(device.dead_count() == population.dead_count());
+  }
+  assert(device.capacity() > 20000);
+
+  const auto result = device.download();
+  assert(result.size() == population.size());
+  assert(result.dead_count() == population.dead_count());
+  assert(result.get_carrying_capacity() == 20500);
+  for (population_index_t i = 0; i < result.size(); ++i) {
+    assert(result.get_vitality(i) == population.get_vitality(i));
+    assert(result.get_species(i) == population.get_species(i));
+    assert(result.get_diet(i) == population.get_diet(i));
+  }
+}
+
+void device_test_1() {
+  Population<string> population;
+  population.add(Plant<string>{"Sosna", 30});
+  population.add(Plant<string>{"Sosna", 30});
+  population.add(Carnivore<string>{"Wilk", 30});
+  population.add(Herbivore<string>{"Koza", 20});
+  DevicePopulation<string> device(population);
+
+  // Błędne pary nie zmieniają populacji.
+  const encounter_pair_t plants[] = {{2, 3}, {0, 1}};
+  bool thrown = false;
+  try {
+    device.encounter_batch(plants);
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  const encounter_pair_t outside[] = {{2, 3}, {0, 4}};
+  thrown = false;
+  try {
+    device.encounter_batch(outside);
+  } catch (const out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+  const encounter_pair_t overlapping[] = {{2, 3}, {3, 2}};
+  thrown = false;
+  try {
+    device.encounter_batch(overlapping);
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(device.download().get_vitality(3) == 20);
+
+  const encounter_pair_t pairs[] = {{2, 3}};
+  assert(device.encounter_batch(pairs) == 0);
+  assert(device.dead_count() == 1);
+  const auto result = device.download();
+  assert(result.get_vitality(2) == 40);
+  assert(result.get_vitality(3) == 0);
+}
+
+// Pary liczone kubełkami według diet dają to samo co encounter_batch, z
+// dziećmi w tej samej kolejności.
+template <typename policy_t>
+void bucket_test_0() {
+  std::mt19937 gen(35);
+  const auto population = random_population<policy_t>(20000, gen);
+  std::mt19937_64 generator(36);
+  const auto pairs = random_matching(population, generator);
+
+  auto expected = population;
+  const size_t expected_births = encounter_batch(expected, span(pairs));
+  auto bucketed = population;
+  assert(encounter_batch_bucketed(bucketed, span(pairs)) == expected_births);
+  assert(expected_births > 0);
+  assert(bucketed.size() == expected.size());
+  assert(bucketed.dead_count() == expected.dead_count());
+  for (population_index_t i = 0; i < expected.size(); ++i) {
+    assert(bucketed.get_vitality(i) == expected.get_vitality(i));
+    assert(bucketed.get_species(i) == expected.get_species(i));
+    assert(bucketed.get_diet(i) == expected.get_diet(i));
+  }
+}
+
+void bucket_test_1() {
+  Population<string> population;
+  population.add(Plant<string>{"Sosna", 30});
+  population.add(Plant<string>{"Sosna", 30});
+  population.add(Carnivore<string>{"Wilk", 30});
+  population.add(Herbivore<string>{"Koza", 20});
+
+  // Błędne pary nie zmieniają populacji.
+  const encounter_pair_t plants[] = {{2, 3}, {0, 1}};
+  bool thrown = false;
+  try {
+    encounter_batch_bucketed(population, span(plants));
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  const encounter_pair_t outside[] = {{2, 3}, {0, 4}};
+  thrown = false;
+  try {
+    encounter_batch_bucketed(population, span(outside));
+  } catch (const out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(population.get_vitality(3) == 20);
+
+  const encounter_pair_t pairs[] = {{1, 3}, {2, 0}};
+  assert(encounter_batch_bucketed(population, span(pairs)) == 0);
+  assert(population.get_vitality(1) == 0);
+  assert(population.get_vitality(3) == 50);
+  assert(population.get_vitality(0) == 30);
+  assert(population.get_vitality(2) == 30);
+
+  // Pary z powtarzającym się organizmem są liczone po kolei.
+  Population<string> chain;
+  chain.add(Carnivore<string>{"Wilk", 200});
+  chain.add(Herbivore<string>{"Koza", 100});
+  chain.add(Plant<string>{"Sosna", 50});
+  auto expected = chain;
+  const encounter_pair_t overlapping[] = {{0, 1}, {1, 2}};
+  encounter_batch(expected, span(overlapping));
+  assert(encounter_batch_bucketed(chain, span(overlapping)) == 0);
+  assert(chain.get_vitality(0) == 250);
+  assert(chain.get_vitality(1) == 0);
+  assert(chain.get_vitality(2) == 50);
+  assert(chain.size() == expected.size());
+  for (population_index_t i = 0; i < chain.size(); ++i) {
+    assert(chain.get_vitality(i) == expected.get_vitality(i));
+  }
+
+  // Powtórzenia razem z parą dwóch roślin: nic się nie zmienia.
+  Population<string> meadow;
+  meadow.add(Carnivore<string>{"Wilk", 200});
+  meadow.add(Herbivore<string>{"Koza", 100});
+  meadow.add(Plant<string>{"Sosna", 50});
+  meadow.add(Plant<string>{"Sosna", 40});
+  const encounter_pair_t rejected[] = {{0, 1}, {0, 1}, {2, 3}};
+  thrown = false;
+  try {
+    encounter_batch_bucketed(meadow, span(rejected));
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(meadow.get_vitality(0) == 200);
+  assert(meadow.get_vitality(1) == 100);
+
+  // Powtórzenia wykrywa bitmapa w małej populacji i sortowanie w dużej.
+  for (const size_t size : {100, 100000}) {
+    assert(pairs_overlap(span(overlapping), size));
+    const encounter_pair_t disjoint[] = {{0, 1}, {2, 99}};
+    assert(!pairs_overlap(span(disjoint), size));
+    const encounter_pair_t self[] = {{5, 5}};
+    assert(pairs_overlap(span(self), size));
+  }
+}
+
+void packed_test_0() {
+  constexpr Omnivore<uint8_t, packed_wrapping_vitality> dog(1, 10);
+  constexpr PackedOrganism<uint8_t> packed(dog);
+  static_assert(packed.get_species() == 1);
+  static_assert(packed.get_diet() == Diet::omnivore);
+  static_assert(packed.get_vitality() == 10);
+  static_assert(packed.as<true, true>().get_vitality() == 10);
+  static_assert(packed.set_vitality(packed_vitality_max).get_species() == 1);
+  static_assert(PackedOrganism<int8_t>(-3, Diet::plant, 0).get_species() == -3);
+  static_assert(PackedOrganism<int8_t>(-3, Diet::plant, 0).is_dead());
+  static_assert(!packed.same_species(
+      PackedOrganism<uint8_t>(1, Diet::carnivore, 10)));
+
+  // Arytmetyka na 48 bitach.
+  static_assert(packed_wrapping_vitality::add(packed_vitality_max, 2) == 1);
+  static_assert(packed_saturating_vitality::add(packed_vitality_max, 2) ==
+                packed_vitality_max);
+  static_assert(packed_saturating_vitality::mean(packed_vitality_max,
+                                                 packed_vitality_max) ==
+                packed_vitality_max);
+
+  bool thrown = false;
+  try {
+    PackedOrganism<uint8_t>(1, Diet::plant, packed_vitality_max + 1);
+  } catch (const out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+  thrown = false;
+  try {
+    PackedOrganism<uint16_t>(1 << 14, Diet::plant, 1);
+  } catch (const out_of_range &) {
+    thrown = true;
+  }
+  assert(thrown);
+  thrown = false;
+  try {
+    packed.as<true, false>();
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  assert(thrown);
+  thrown = false;
+  try {
+    packed_checked_vitality::add(packed_vitality_max, 1);
+  } catch (const std::overflow_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+// Spakowane organizmy liczą to samo co populacja z tą samą polityką, także
+// przy witalnościach bliskich packed_vitality_max.
+template <typename policy_t>
+void packed_test_1() {
+  std::mt19937_64 gen(37);
+  const Diet diets[] = {Diet::carnivore, Diet::omnivore, Diet::herbivore,
+                        Diet::plant};
+  Population<uint8_t, policy_t> population;
+  vector<PackedOrganism<uint8_t, policy_t>> organisms;
+  for (size_t i = 0; i < 20000; ++i) {
+    const auto species = static_cast<uint8_t>(gen() % 3);
+    const Diet diet = diets[gen() % 4];
+    const vitality_t vitality =
+        gen() % 2 == 0 ? gen() % 4 * 20 : packed_vitality_max - gen() % 100;
+    population.add(species, diet, vitality);
+    organisms.emplace_back(species, diet, vitality);
+  }
+  std::mt19937_64 generator(38);
+  const auto pairs = random_matching(population, generator);
+
+  auto simd = population;
+  const size_t births = encounter_batch(population, span(pairs));
+  assert(births > 0);
+  assert(encounter_batch_simd(simd, span(pairs)) == births);
+  assert(encounter_batch(organisms, span(pairs)) == births);
+  assert(organisms.size() == population.size());
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(organisms[i].get_vitality() == population.get_vitality(i));
+    assert(organisms[i].get_species() == population.get_species(i));
+    assert(organisms[i].get_diet() == population.get_diet(i));
+    assert(simd.get_vitality(i) == population.get_vitality(i));
+  }
+}
+
+// Runda liczona kawałkami daje to samo co encounter_round.
+void task_test_0() {
+  std::mt19937 gen(39);
+  Population<string> population = random_population(20000, gen);
+  population.set_carrying_capacity(15000);
+  const CounterRng rng(40);
+  ThreadPool pool(3);
+
+  auto expected = population;
+  const auto pairs = random_matching(expected, rng, 0, pool);
+  auto matching = random_matching_steps(population, rng, 0, 1000);
+  assert(!matching.done());
+  size_t pauses = 0;
+  while (matching.resume()) {
+    ++pauses;
+  }
+  assert(pauses > 20);
+  assert(matching.get() == pairs);
+
+  const size_t expected_born = encounter_round(expected, span(pairs), pool);
+  size_t observed = 0;
+  auto round = encounter_round_steps(
+      population, span(pairs), 100,
+      [&](population_index_t, population_index_t, const auto &) {
+        ++observed;
+      });
+  pauses = 0;
+  while (round.resume()) {
+    assert(population.size() == 20000);
+    ++pauses;
+  }
+  assert(pauses == pairs.size() / 100);
+  assert(observed == pairs.size());
+  assert(round.get() == expected_born);
+  assert(population.size() == expected.size());
+  assert(population.dead_count() == expected.dead_count());
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(population.get_vitality(i) == expected.get_vitality(i));
+    assert(population.get_species(i) == expected.get_species(i));
+  }
+
+  // Kilka rund naraz, jak simulate_round.
+  size_t expected_total = 0;
+  for (uint64_t round_number = 1; round_number < 4; ++round_number) {
+    expected_total += simulate_round(expected, rng, round_number, pool);
+  }
+  assert(simulate_rounds_steps(population, rng, 1, 3, 500).run() ==
+         expected_total);
+  assert(population.size() == expected.size());
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    assert(population.get_vitality(i) == expected.get_vitality(i));
+  }
+}
+
+void task_test_1() {
+  std::mt19937 gen(41);
+  const Population<string> population = random_population(2000, gen);
+  population_index_t hunter = 0;
+  while (population.get_diet(hunter) != Diet::carnivore ||
+         population.get_vitality(hunter) == 0) {
+    ++hunter;
+  }
+  vector<population_index_t> prey;
+  for (population_index_t i = 0; i < population.size(); ++i) {
+    if (i != hunter) {
+      prey.push_back(i);
+    }
+  }
+  const auto expected =
+      encounter_series_counted(population, hunter, span(prey));
+  auto series = encounter_series_steps(population, hunter, span(prey), 7);
+  bool thrown = false;
+  try {
+    series.get();
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  const auto result = series.run();
+  assert(result.hunter == expected.hunter);
+  assert(result.encounters == expected.encounters);
+
+  // Wyjątek z zadania wychodzi z resume.
+  Population<string> plants;
+  plants.add(Plant<string>{"Sosna", 30});
+  plants.add(Plant<string>{"Sosna", 30});
+  const encounter_pair_t pair[] = {{0, 1}};
+  auto task = encounter_round_steps(plants, span(pair), 10);
+  thrown = false;
+  try {
+    task.resume();
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(task.done());
+
+  // Po przeniesieniu stara zmienna jest skończona i bez wyniku.
+  auto moved = encounter_series_steps(population, hunter, span(prey), 7);
+  auto target = std::move(moved);
+  assert(moved.done());
+  assert(!moved.resume());
+  thrown = false;
+  try {
+    moved.get();
+  } catch (const logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(target.run().hunter == expected.hunter);
+}
+
+// Liczniki dostępne na danej maszynie mają wartości, a niedostępne mają
+// powód; task_clock liczy też wątki puli utworzonej po licznikach.
+void perf_test_0() {
+  assert(perf_event_name(PerfEvent::branch_misses) == "branch-misses");
+  PerfCounters counters;
+  for (size_t event = 0; event < perf_event_count; ++event) {
+    const auto kind = static_cast<PerfEvent>(event);
+    assert(counters.available(kind) == !counters.unavailable_reason(kind));
+  }
+  ThreadPool pool(2);
+  std::atomic<uint64_t> work = 0;
+  auto spin = [&] {
+    pool.parallel_for(2, [&](size_t, size_t) {
+      uint64_t state = 1;
+      for (int i = 0; i < 20000000; ++i) {
+        state = state * 6364136223846793005u + 1442695040888963407u;
+      }
+      work += state;
+    });
+  };
+  const perf_sample sample = counters.measure(spin);
+  for (size_t event = 0; event < perf_event_count; ++event) {
+    const auto kind = static_cast<PerfEvent>(event);
+    assert(sample[kind].has_value() == counters.available(kind));
+  }
+  if (counters.available(PerfEvent::task_clock)) {
+    assert(*sample[PerfEvent::task_clock] > 0);
+    // Po stop liczniki stoją, a start je zeruje.
+    spin();
+    assert(counters.read()[PerfEvent::task_clock] ==
+           sample[PerfEvent::task_clock]);
+    counters.start();
+    assert(*counters.stop()[PerfEvent::task_clock] <
+           *sample[PerfEvent::task_clock]);
+  }
+  if (counters.available(PerfEvent::instructions)) {
+    assert(*sample[PerfEvent::instructions] > 40000000);
+  }
+  assert(work.load() != 0);
+}
+
 int main() {
   org_test_0();
   org_test_1();
@@ -1321,5 +3516,74 @@ int main() {
   org_test_105();
   org_test_106();
   org_test_107();
+  population_test_0();
+  population_test_1();
+  population_test_2();
+  population_test_3();
+  population_test_4();
+  move_test_0();
+  move_test_1();
+  move_test_2();
+  move_test_3();
+  registry_test_0();
+  registry_test_1();
+  registry_test_2();
+  scheduler_test_0();
+  scheduler_test_1();
+  scheduler_test_2();
+  scheduler_test_3();
+  series_test_0();
+  series_test_1();
+  series_test_2();
+  series_test_3();
+  series_test_4();
+  series_test_5();
+  outcome_test_0();
+  outcome_test_1();
+  interaction_test_0();
+  any_test_0();
+  any_test_1();
+  any_test_2();
+  arena_test_0();
+  arena_test_1();
+  arena_test_2();
+  compaction_test_0();
+  compaction_test_1();
+  compaction_test_2();
+  counters_test_0();
+  counters_test_1();
+  vitality_test_0();
+  vitality_test_1<uint64_t>();
+  vitality_test_1<uint32_t>();
+  vitality_test_1<uint16_t>();
+  vitality_test_2();
+  ecosystem_test_0();
+  ecosystem_test_1();
+  spatial_test_0();
+  spatial_test_1();
+  snapshot_test_0();
+  snapshot_test_1();
+  event_log_test_0();
+  event_log_test_1();
+  stats_test_0();
+  stats_test_1();
+  capacity_test_0();
+  capacity_test_1();
+  sharding_test_0();
+  sharding_test_1();
+  sharding_test_2();
+  device_test_0<wrapping_vitality>();
+  device_test_0<basic_saturating_vitality<uint16_t>>();
+  device_test_1();
+  bucket_test_0<wrapping_vitality>();
+  bucket_test_0<basic_saturating_vitality<uint16_t>>();
+  bucket_test_0<checked_vitality>();
+  bucket_test_1();
+  packed_test_0();
+  packed_test_1<packed_wrapping_vitality>();
+  packed_test_1<packed_saturating_vitality>();
+  task_test_0();
+  task_test_1();
+  perf_test_0();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#ifndef JNP1_THREAD_POOL_H
+#define JNP1_THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Stała pula wątków wykonująca pętle równoległe. Wątek wołający parallel_for
+// też liczy zadania (jako wątek numer 0). Każdy wątek dostaje na start równy
+// przedział zadań i bierze je od początku; wątek, któremu zabraknie pracy,
+// zabiera drugą połowę przedziału innego wątku. Dzięki temu zadania o bardzo
+// różnym czasie trwania nie zostawiają bezczynnych wątków.
+class ThreadPool {
+  // Zadania [begin, end) czekające na danym wątku.
+  struct alignas(64) task_range {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  std::function<void(size_t, size_t)> job;
+  std::unique_ptr<task_range[]> ranges;
+  size_t active_workers = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+  std::vector<std::thread> workers;
+
+  bool pop_task(size_t worker, size_t &task) {
+    task_range &own = ranges[worker];
+    std::lock_guard lock(own.mutex);
+    if (own.begin == own.end) {
+      return false;
+    }
+    task = own.begin++;
+    return true;
+  }
+
+  bool steal_tasks(size_t worker) {
+    for (size_t offset = 1; offset < size(); ++offset) {
+      task_range &victim = ranges[(worker + offset) % size()];
+      size_t begin, end;
+      {
+        std::lock_guard lock(victim.mutex);
+        if (victim.begin == victim.end) {
+          continue;
+        }
+        begin = victim.begin + (victim.end - victim.begin) / 2;
+        end = victim.end;
+        victim.end = begin;
+      }
+      task_range &own = ranges[worker];
+      std::lock_guard lock(own.mutex);
+      own.begin = begin;
+      own.end = end;
+      return true;
+    }
+    return false;
+  }
+
+  void run_tasks(size_t worker) {
+    size_t task;
+    while (true) {
+      if (!pop_task(worker, task)) {
+        if (!steal_tasks(worker)) {
+          return;
+        }
+        continue;
+      }
+      try {
+        job(task, worker);
+      } catch (...) {
+        std::lock_guard lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  }
+
+  void worker_loop(size_t worker) {
+    uint64_t seen_generation = 0;
+    std::unique_lock lock(mutex);
+    while (true) {
+      work_ready.wait(lock, [&] {
+        return stopping || generation != seen_generation;
+      });
+      if (stopping) {
+        return;
+      }
+      seen_generation = generation;
+      lock.unlock();
+      run_tasks(worker);
+      lock.lock();
+      if (--active_workers == 0) {
+        work_done.notify_one();
+      }
+    }
+  }
+
+ public:
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<size_t>(threads, 1);
+    ranges = std::make_unique<task_range[]>(threads);
+    workers.reserve(threads - 1);
+    for (size_t worker = 1; worker < threads; ++worker) {
+      workers.emplace_back([this, worker] {
+        worker_loop(worker);
+      });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Liczba wątków razem z wołającym.
+  size_t size() const {
+    return workers.size() + 1;
+  }
+
+  // Wywołuje fn(task, worker) dla task z [0, tasks) i czeka na wszystkie.
+  // Pierwszy wyjątek rzucony przez zadanie jest rzucany dalej.
+  void parallel_for(size_t tasks, std::function<void(size_t, size_t)> fn) {
+    {
+      std::lock_guard lock(mutex);
+      job = std::move(fn);
+      for (size_t worker = 0; worker < size(); ++worker) {
+        std::lock_guard range_lock(ranges[worker].mutex);
+        ranges[worker].begin = tasks * worker / size();
+        ranges[worker].end = tasks * (worker + 1) / size();
+      }
+      active_workers = workers.size();
+      error = nullptr;
+      ++generation;
+    }
+    work_ready.notify_all();
+    run_tasks(0);
+
+    std::unique_lock lock(mutex);
+    work_done.wait(lock, [&] {
+      return active_workers == 0;
+    });
+    job = nullptr;
+    if (error) {
+      std::rethrow_exception(std::exchange(error, nullptr));
+    }
+  }
+};
+
+#endif  // JNP1_THREAD_POOL_H